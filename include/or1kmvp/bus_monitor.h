@@ -0,0 +1,78 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef OR1KMVP_BUS_MONITOR_H
+#define OR1KMVP_BUS_MONITOR_H
+
+#include "or1kmvp/common.h"
+#include "or1kmvp/histogram.h"
+
+#include <tlm_utils/simple_initiator_socket.h>
+#include <tlm_utils/simple_target_socket.h>
+
+namespace or1kmvp {
+
+    typedef std::vector<std::pair<std::string, vcml::range>> address_map;
+
+    // Sits between an initiator and the bus, forwards all transport calls
+    // unchanged and counts accesses per target window of the address map.
+    class bus_monitor: public sc_core::sc_module
+    {
+    public:
+        struct stats {
+            vcml::u64 reads;
+            vcml::u64 writes;
+            vcml::u64 bytes;
+            vcml::u64 errors;
+            vcml::u64 dmi_allowed;
+            vcml::u64 dmi_grants;
+            vcml::u64 debug;
+            histogram latency; // in nanoseconds
+
+            stats(): reads(), writes(), bytes(), errors(), dmi_allowed(),
+                dmi_grants(), debug(), latency() {}
+        };
+
+    private:
+        const address_map& m_map;
+        std::vector<stats> m_stats; // one per window, last one is unmapped
+
+        stats& lookup(vcml::u64 addr);
+
+        void b_transport(tlm::tlm_generic_payload& tx, sc_core::sc_time& t);
+        bool get_direct_mem_ptr(tlm::tlm_generic_payload& tx,
+                                tlm::tlm_dmi& dmi);
+        unsigned int transport_dbg(tlm::tlm_generic_payload& tx);
+        void invalidate_direct_mem_ptr(sc_dt::uint64 start,
+                                       sc_dt::uint64 end);
+
+    public:
+        tlm_utils::simple_target_socket<bus_monitor, 64> IN;
+        tlm_utils::simple_initiator_socket<bus_monitor, 64> OUT;
+
+        bus_monitor() = delete;
+        bus_monitor(const sc_core::sc_module_name& nm, const address_map& m);
+        virtual ~bus_monitor();
+
+        void clear();
+        void report(const std::string& initiator, std::ostream& os) const;
+    };
+
+}
+
+#endif
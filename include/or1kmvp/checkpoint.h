@@ -0,0 +1,62 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef OR1KMVP_CHECKPOINT_H
+#define OR1KMVP_CHECKPOINT_H
+
+#include "or1kmvp/common.h"
+
+namespace or1kmvp {
+
+    class checkpoint
+    {
+    private:
+        std::iostream& m_stream;
+
+    public:
+        checkpoint() = delete;
+        checkpoint(std::iostream& stream);
+        virtual ~checkpoint();
+
+        bool good() const { return m_stream.good(); }
+
+        void write(const void* data, size_t size);
+        void write(const std::string& str);
+
+        void read(void* data, size_t size);
+        std::string read_string();
+
+        template <typename T> void write(const T& val);
+        template <typename T> T read();
+    };
+
+    template <typename T>
+    inline void checkpoint::write(const T& val) {
+        write(&val, sizeof(val));
+    }
+
+    template <typename T>
+    inline T checkpoint::read() {
+        T val = T();
+        read(&val, sizeof(val));
+        return val;
+    }
+
+}
+
+#endif
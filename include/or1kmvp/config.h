@@ -73,6 +73,18 @@
 #define OR1KMVP_SDHCI_SIZE      (OR1KISS_PAGE_SIZE)
 #define OR1KMVP_SDHCI_END       (OR1KMVP_SDHCI_ADDR + OR1KMVP_SDHCI_SIZE - 1)
 
+#define OR1KMVP_VBLK_ADDR       (0x9b000000)
+#define OR1KMVP_VBLK_SIZE       (OR1KISS_PAGE_SIZE)
+#define OR1KMVP_VBLK_END        (OR1KMVP_VBLK_ADDR + OR1KMVP_VBLK_SIZE - 1)
+
+#define OR1KMVP_VNET_ADDR       (0x9c000000)
+#define OR1KMVP_VNET_SIZE       (OR1KISS_PAGE_SIZE)
+#define OR1KMVP_VNET_END        (OR1KMVP_VNET_ADDR + OR1KMVP_VNET_SIZE - 1)
+
+#define OR1KMVP_VCON_ADDR       (0x9d000000)
+#define OR1KMVP_VCON_SIZE       (OR1KISS_PAGE_SIZE)
+#define OR1KMVP_VCON_END        (OR1KMVP_VCON_ADDR + OR1KMVP_VCON_SIZE - 1)
+
 /* Interrupt map */
 #define OR1KMVP_IRQ_OMPIC       (1)
 #define OR1KMVP_IRQ_UART0       (2)
@@ -82,5 +94,8 @@
 #define OR1KMVP_IRQ_OCKBD       (6)
 #define OR1KMVP_IRQ_OCSPI       (7)
 #define OR1KMVP_IRQ_SDHCI       (8)
+#define OR1KMVP_IRQ_VBLK        (9)
+#define OR1KMVP_IRQ_VNET        (10)
+#define OR1KMVP_IRQ_VCON        (11)
 
 #endif
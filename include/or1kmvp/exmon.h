@@ -0,0 +1,100 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef OR1KMVP_EXMON_H
+#define OR1KMVP_EXMON_H
+
+#include "or1kmvp/common.h"
+
+#define OR1KMVP_EXMON_SHARDS (64) // power of two
+#define OR1KMVP_EXMON_MAXCORE (64)
+#define OR1KMVP_EXMON_HOTMAX  (64) // contention stats kept per shard
+
+namespace or1kmvp {
+
+    // Global exclusive monitor for l.lwa/l.swa. Reservations are tracked per
+    // granule as a bitmask of the cores holding them, so that exclusive
+    // accesses to memory reachable via DMI can be served directly from the
+    // core threads instead of going through the bus. A store conditional
+    // succeeds if the core still holds its reservation and a host
+    // compare-and-swap from the value seen by the lwa succeeds; it then
+    // clears the reservations of all cores on the granule. Granules are
+    // spread across independently locked shards to keep contention between
+    // cores low. Plain stores through DMI bypass the monitor and do not
+    // clear reservations, so the swa only fails if the reserved word holds
+    // a different value when it executes; a plain store that wrote back
+    // the same value (ABA) goes unnoticed, unlike on real hardware.
+    class exmon
+    {
+    public:
+        struct stats {
+            vcml::u64 addr;
+            vcml::u64 num_lwa;
+            vcml::u64 num_swa;
+            vcml::u64 num_failed;
+        };
+
+    private:
+        struct shard {
+            std::mutex mtx;
+            std::unordered_map<vcml::u64, vcml::u64> reserved;
+            std::unordered_map<vcml::u64, stats> hot;
+        };
+
+        struct reservation {
+            bool valid;
+            vcml::u64 granule;
+            vcml::u32 value;
+        };
+
+        vcml::u64 m_granule;
+        shard m_shards[OR1KMVP_EXMON_SHARDS];
+        reservation m_cores[OR1KMVP_EXMON_MAXCORE];
+
+        vcml::u64 granule(vcml::u64 addr) const { return addr / m_granule; }
+        shard& lookup(vcml::u64 g) {
+            return m_shards[g & (OR1KMVP_EXMON_SHARDS - 1)];
+        }
+
+        static vcml::u32 peek(const vcml::u8* ptr, unsigned int size);
+        static bool swap(vcml::u8* ptr, vcml::u32 expected,
+                         const void* data, unsigned int size);
+
+        void release(unsigned int core);
+        stats& record(shard& s, vcml::u64 g);
+
+    public:
+        vcml::u64 granule_size() const { return m_granule; }
+
+        exmon() = delete;
+        exmon(vcml::u64 granule);
+        virtual ~exmon();
+
+        void load(unsigned int core, vcml::u64 addr, const vcml::u8* ptr,
+                  void* data, unsigned int size);
+        bool store(unsigned int core, vcml::u64 addr, vcml::u8* ptr,
+                   const void* data, unsigned int size);
+
+        void cancel_reservations();
+        void clear();
+        std::vector<stats> hot_locks(size_t max);
+    };
+
+}
+
+#endif
@@ -0,0 +1,77 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef OR1KMVP_HISTOGRAM_H
+#define OR1KMVP_HISTOGRAM_H
+
+#include "or1kmvp/common.h"
+
+namespace or1kmvp {
+
+    // Fixed size histogram with power-of-two buckets: bucket 0 counts zero
+    // values, bucket i counts values in [2^(i-1), 2^i). Recording a value is
+    // a handful of instructions, so it can stay enabled at all times.
+    // Percentiles are estimated as the upper limit of the bucket containing
+    // them, clamped to the largest value seen.
+    class histogram
+    {
+    public:
+        enum { NUM_BUCKETS = 65 };
+
+    private:
+        vcml::u64 m_buckets[NUM_BUCKETS];
+        vcml::u64 m_count;
+        vcml::u64 m_sum;
+        vcml::u64 m_max;
+
+    public:
+        vcml::u64 count() const { return m_count; }
+        vcml::u64 sum() const { return m_sum; }
+        vcml::u64 max() const { return m_max; }
+        vcml::u64 bucket(unsigned int i) const { return m_buckets[i]; }
+
+        double mean() const {
+            return m_count == 0 ? 0.0 : (double)m_sum / m_count;
+        }
+
+        histogram();
+        virtual ~histogram();
+
+        void clear();
+        void add(vcml::u64 val);
+        void merge(const histogram& other);
+
+        vcml::u64 percentile(double p) const;
+
+        static vcml::u64 bucket_limit(unsigned int i);
+
+        void write_json(std::ostream& os) const;
+    };
+
+    inline void histogram::add(vcml::u64 val) {
+        unsigned int idx = val == 0 ? 0 : 64 - __builtin_clzll(val);
+        m_buckets[idx]++;
+        m_count++;
+        m_sum += val;
+        if (val > m_max)
+            m_max = val;
+    }
+
+}
+
+#endif
@@ -0,0 +1,95 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef OR1KMVP_MEMORY_H
+#define OR1KMVP_MEMORY_H
+
+#include "or1kmvp/common.h"
+#include "or1kmvp/snapshot.h"
+
+namespace or1kmvp {
+
+    // Main memory backed by an anonymous host mapping. Images are mapped
+    // copy-on-write from their files instead of being read into memory, so
+    // loading is independent of image size and pages that are never written
+    // remain shared with the host page cache across simulator instances.
+    // While a snapshot is tracking, DMI is granted in groups of
+    // dirty_granule pages on access and write access only for groups that
+    // have been marked dirty, so that every initiator is covered regardless
+    // of how it reaches memory.
+    class memory: public vcml::peripheral
+    {
+    private:
+        vcml::u8* m_memory;
+        vcml::u64 m_length;
+        vcml::u64 m_host_page;
+        bool m_hugetlb;
+        vcml::u64 m_num_mapped;
+        vcml::u64 m_num_copied;
+
+        snapshot* m_snapshot;
+        std::vector<vcml::vcml_access> m_granted;
+
+        bool is_tracking() const;
+        void track_access(const vcml::range& addr, bool write, bool debug);
+
+        void allocate();
+        void load_images();
+
+        bool map_image(const std::string& file, vcml::u64 offset);
+        bool copy_image(const std::string& file, vcml::u64 offset);
+
+    public:
+        vcml::property<vcml::u64> size;
+        vcml::property<std::string> images;
+        vcml::property<bool> map_images;
+        vcml::property<bool> transparent_hugepages;
+        vcml::property<bool> explicit_hugepages;
+        vcml::property<vcml::u64> dirty_granule;
+
+        vcml::slave_socket IN;
+
+        vcml::u8* get_data_ptr() const { return m_memory; }
+        vcml::u64 page_size() const { return m_host_page; }
+
+        vcml::u64 touched_pages() const;
+
+        void clear();
+
+        void set_snapshot(snapshot* snap) { m_snapshot = snap; }
+        void start_tracking();
+
+        memory() = delete;
+        memory(const sc_core::sc_module_name& name, vcml::u64 size);
+        virtual ~memory();
+
+        virtual void reset() override;
+
+        virtual tlm::tlm_response_status read(const vcml::range& addr,
+                                              void* data,
+                                              const vcml::sideband& info)
+            override;
+        virtual tlm::tlm_response_status write(const vcml::range& addr,
+                                               const void* data,
+                                               const vcml::sideband& info)
+            override;
+    };
+
+}
+
+#endif
@@ -21,23 +21,234 @@
 
 #include "or1kmvp/common.h"
 #include "or1kmvp/config.h"
+#include "or1kmvp/checkpoint.h"
+#include "or1kmvp/tracer.h"
+#include "or1kmvp/profiler.h"
+#include "or1kmvp/histogram.h"
+#include "or1kmvp/exmon.h"
+
+#define OR1KMVP_DMI_CACHE_SIZE (256) // pages per socket, power of two
+#define OR1KMVP_SPIN_HISTORY   (8)   // core state signatures remembered
+#define OR1KMVP_TRACE_BLOCKS   (1024) // traced block lengths, power of two
+#define OR1KMVP_TRACE_MAXBLOCK (64)   // instructions per traced block
 
 namespace or1kmvp {
 
+    // Peripheral windows that can be called directly instead of going through
+    // the bus, indexed by the most significant address byte. Regions holding
+    // more than one window are marked shared and always use the bus.
+    struct mmio_target {
+        vcml::range addr;
+        tlm::tlm_fw_transport_if<>* target;
+        bool shared;
+    };
+
+    typedef std::vector<mmio_target> mmio_table;
+
     class openrisc: public vcml::processor,
                     private or1kiss::env {
     private:
         or1kiss::or1k* m_iss;
 
+        vcml::u64 m_num_ipis;
+        vcml::u64 m_num_mmio;
+        vcml::u64 m_num_kicks;
+        vcml::u64 m_num_slices;
+
+        bool m_ipi_pending;
+        sc_core::sc_time m_ipi_raised;
+        vcml::u64 m_ipi_count;
+        sc_core::sc_time m_ipi_latency;
+        sc_core::sc_time m_ipi_latency_max;
+
+        tracer* m_tracer;
+        tracer::ring* m_trace_ring;
+        bool m_trace_regs;
+        vcml::u64 m_trace_vpage;
+        vcml::u64 m_trace_ppage;
+        or1kiss::u32 m_trace_gpr[32];
+
+        struct trace_block {
+            vcml::u64 addr;
+            unsigned int length;
+            bool safe;
+        };
+
+        trace_block m_trace_blocks[OR1KMVP_TRACE_BLOCKS];
+
+        profiler m_profiler;
+        vcml::u64 m_prof_next;
+
+        struct dmi_entry {
+            bool valid;
+            bool allowed;
+            vcml::u64 page;
+            vcml::u8* ptr;
+            vcml::u64 start;
+            vcml::u64 end;
+        };
+
+        // [0] insn, [1] data read/write, [2] data read-only
+        dmi_entry m_dmi_cache[3][OR1KMVP_DMI_CACHE_SIZE];
+        vcml::u64 m_dmi_hits;
+        vcml::u64 m_dmi_neg_hits;
+        vcml::u64 m_dmi_misses;
+
+        struct irq_latency {
+            bool raised;
+            bool applied;
+            sc_core::sc_time raise_time;
+            vcml::u64 raise_insns;
+            histogram time_ns;
+            histogram insns;
+
+            irq_latency(): raised(false), applied(false), raise_time(),
+                raise_insns(0), time_ns(), insns() {}
+        };
+
+        std::map<unsigned int, irq_latency> m_irq_latency;
+
+        std::atomic<vcml::u64> m_pub_insns;
+        std::atomic<vcml::u64> m_pub_cycles;
+        std::atomic<vcml::u64> m_pub_sleep;
+        std::atomic<double> m_pub_hit_rate;
+        std::atomic<double> m_pub_time;
+        std::atomic<vcml::u64> m_pub_excl;
+
+        const mmio_table* m_mmio_table;
+        vcml::u64 m_num_mmio_fast;
+
+        exmon* m_exmon;
+        vcml::u64 m_num_excl_fast;
+
+        vcml::u64 m_spin_sigs[OR1KMVP_SPIN_HISTORY];
+        unsigned int m_spin_next;
+        unsigned int m_spin_hits;
+        vcml::u64 m_num_spin_skips;
+        vcml::u64 m_spin_skipped;
+
+        bool m_ff_active;
+        std::atomic<bool> m_ff_stop;
+        std::vector<vcml::u32> m_ff_markers;
+        std::function<void(void)> m_ff_notify;
+        double m_ff_start;
+        double m_ff_realtime;
+        vcml::u64 m_ff_insns;
+
+        std::map<vcml::u32, unsigned int> m_semi_sites;
+        std::vector<int> m_semi_fds;
+        vcml::u64 m_num_semi_calls;
+        bool m_exited;
+        int m_exit_status;
+        vcml::u64 m_semi_held;
+
+        std::map<vcml::u32, unsigned int> m_bp_refs;
+        std::set<vcml::u32> m_gdb_bps;
+
+        std::vector<openrisc*> m_peers;
+        std::atomic<bool> m_idle;
+        std::atomic<vcml::u64> m_idle_cycles;
+        vcml::u64 m_num_idle_skips;
+        vcml::u64 m_idle_skipped;
+
+        sc_core::sc_time m_quantum_start;
+        sc_core::sc_time m_quantum_cycle;
+        vcml::u64 m_quantum_cycles;
+
+        std::thread m_worker;
+        std::mutex m_worker_mtx;
+        std::condition_variable m_worker_cv;
+        bool m_worker_exit;
+        bool m_worker_busy;
+        bool m_work_pending;
+        unsigned int m_work_cycles;
+        or1kiss::step_result m_work_result;
+        const or1kiss::request* m_work_req;
+        or1kiss::response m_work_resp;
+        std::vector<std::pair<unsigned int, bool>> m_work_irqs;
+        std::vector<sc_core::sc_time> m_work_ipis;
+        bool m_work_dmi_stale;
+
+        or1kiss::or1k* create_iss(vcml::u64 id);
+
+        void worker_thread();
+        void drop_stale_dmi();
+        void flush_pending();
+        void drop_dmi();
+        void apply_interrupt(unsigned int irq, bool set);
+        void record_ipi_latency();
+        void update_idle_state();
+        bool detect_spin();
+        vcml::u64 skip_spin(vcml::u64 cycles);
+        void advance_timer(vcml::u64 cycles);
+        void publish_stats();
+        or1kiss::step_result step_iss(unsigned int cycles);
+        or1kiss::step_result step_trace(unsigned int cycles);
+        or1kiss::step_result step_core(unsigned int cycles);
+        vcml::u64 trace_translate(vcml::u32 pc);
+        bool trace_fetch(vcml::u64 addr, or1kiss::u32& insn);
+        bool trace_scan(vcml::u32 pc, unsigned int& length);
+        void trace_flush();
+        void trace_single(vcml::u32 pc, vcml::u64 retired);
+        void trace_exception(vcml::u32 pc, vcml::u64 retired,
+                             or1kiss::u32 epcr);
+        void trace_gprs();
+        void trace_record(unsigned int reg, vcml::u32 pc, vcml::u64 count,
+                          or1kiss::u32 value);
+
+        bool read_virt(vcml::u32 va, vcml::u32& val);
+        void sample_stack();
+        bool start_profiling();
+        unsigned int idle_skip(unsigned int cycles);
+        void simulate_parallel(unsigned int cycles);
+        void handle_step_result(or1kiss::step_result result);
+        bool leave_fastforward();
+
+        void ref_breakpoint(vcml::u32 addr);
+        void unref_breakpoint(vcml::u32 addr);
+
+        void start_semihosting();
+        bool semihost(or1kiss::step_result& result);
+        bool semihost_translate(vcml::u32 va, vcml::u32& pa, bool write);
+        vcml::u8* semihost_ptr(vcml::u32 va, vcml::u32 size, bool write);
+        bool semihost_copy(vcml::u32 va, void* buf, vcml::u32 size,
+                           bool write);
+        bool semihost_memcpy(vcml::u32 dst, vcml::u32 src, vcml::u32 size);
+        bool semihost_memset(vcml::u32 dst, vcml::u8 val, vcml::u32 size);
+        bool semihost_string(vcml::u32 va, std::string& str);
+        vcml::u32 semihost_io(int fd, vcml::u32 va, vcml::u32 size,
+                              bool write);
+
+        or1kiss::response transact_bus(const or1kiss::request& req);
+
+        bool lookup_dmi(bool data, bool write, vcml::u64 addr,
+                        unsigned int size, bool negative, dmi_entry& result);
+        void flush_dmi_cache();
+
+        bool transact_load(const or1kiss::request& req);
+        bool transact_fast(const or1kiss::request& req,
+                           tlm::tlm_response_status& rs);
+        bool transact_exclusive(const or1kiss::request& req,
+                                or1kiss::response& resp);
+
         bool cmd_gdb(const std::vector<std::string>& args, std::ostream& os);
         bool cmd_pic(const std::vector<std::string>& args, std::ostream& os);
         bool cmd_spr(const std::vector<std::string>& args, std::ostream& os);
+        bool cmd_prof(const std::vector<std::string>& args, std::ostream& os);
 
     public:
         vcml::property<bool> enable_decode_cache;
+        vcml::property<unsigned int> decode_cache_size;
         vcml::property<bool> enable_sleep_mode;
         vcml::property<bool> enable_insn_dmi;
         vcml::property<bool> enable_data_dmi;
+        vcml::property<bool> enable_parallel;
+        vcml::property<bool> enable_fast_mmio;
+        vcml::property<unsigned int> kick_cycles;
+        vcml::property<unsigned int> kick_cycles_max;
+        vcml::property<sc_core::sc_time> idle_skip_max;
+        vcml::property<unsigned int> spin_skip;
+        vcml::property<bool> semihosting;
 
         vcml::property<unsigned int> irq_ompic;
         vcml::property<unsigned int> irq_uart0;
@@ -47,17 +258,63 @@ namespace or1kmvp {
         vcml::property<unsigned int> irq_ockbd;
         vcml::property<unsigned int> irq_ocspi;
         vcml::property<unsigned int> irq_sdhci;
+        vcml::property<unsigned int> irq_vblk;
+        vcml::property<unsigned int> irq_vnet;
+        vcml::property<unsigned int> irq_vcon;
+
+        vcml::property<unsigned int> profile_period;
+        vcml::property<std::string> profile_file;
 
         vcml::property<std::string> insn_trace_file;
         vcml::property<std::string> gdb_term;
 
         vcml::u64 insn_count() const { return m_iss->get_num_instructions(); }
+        vcml::u64 ipi_count() const { return m_num_ipis; }
+        vcml::u64 mmio_count() const { return m_num_mmio; }
+        vcml::u64 excl_count() const { return m_pub_excl; }
+
         void log_timing_info() const;
 
+        // Snapshot of the statistics from the end of the last quantum that
+        // can safely be read from any thread.
+        vcml::u64 published_insns() const { return m_pub_insns; }
+        vcml::u64 published_cycles() const { return m_pub_cycles; }
+        vcml::u64 published_sleep() const { return m_pub_sleep; }
+        double published_hit_rate() const { return m_pub_hit_rate; }
+        double published_time() const { return m_pub_time; }
+        void write_irq_latency(std::ostream& os) const;
+
+        bool is_executing();
+        bool is_sleeping() const;
+        vcml::u64 cycles_to_tick() const;
+
+        void save_state(checkpoint& cp);
+        void load_state(checkpoint& cp);
+        void flush_decode_cache();
+        void flush_decode_cache(const vcml::range& mem);
+        void invalidate_data_dmi();
+
+        void set_peers(const std::vector<openrisc*>& p) { m_peers = p; }
+        void set_tracer(tracer* t, bool regs);
+        void set_mmio_table(const mmio_table* t) { m_mmio_table = t; }
+        void set_exmon(exmon* mon) { m_exmon = mon; }
+
+        bool is_fastforward() const { return m_ff_active; }
+        bool start_fastforward(const std::string& symbol, unsigned int nop,
+                               std::function<void(void)> notify);
+        void stop_fastforward() { m_ff_stop = true; }
+
+        bool exit_status(int& status) const {
+            status = m_exit_status;
+            return m_exited;
+        }
+
         openrisc(const sc_core::sc_module_name& nm, unsigned int coreid);
         virtual ~openrisc();
 
         virtual void reset() override;
+        virtual void start_of_simulation() override;
+        virtual void end_of_simulation() override;
 
         virtual bool disassemble(vcml::u8*, vcml::u64&, std::string&) override;
 
@@ -77,6 +334,10 @@ namespace or1kmvp {
 
         virtual or1kiss::response transact(const or1kiss::request& r) override;
 
+        virtual void invalidate_direct_mem_ptr(vcml::master_socket* origin,
+                                               vcml::u64 start,
+                                               vcml::u64 end) override;
+
         virtual bool read_reg_dbg(vcml::u64 idx, vcml::u64& val) override;
         virtual bool write_reg_dbg(vcml::u64 idx, vcml::u64 val) override;
 
@@ -0,0 +1,67 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef OR1KMVP_PROFILER_H
+#define OR1KMVP_PROFILER_H
+
+#include "or1kmvp/common.h"
+#include "or1kmvp/symtab.h"
+
+#define OR1KMVP_PROFILE_MAXSTACKS (65536) // distinct stacks kept
+
+namespace or1kmvp {
+
+    // Aggregates sampled call stacks of a processor and writes them in the
+    // folded format expected by flamegraph.pl (one "a;b;c count" per line).
+    // Frames are folded to the start of their function when sampled. Once
+    // the table is full, samples of new stacks are only counted as [other].
+    class profiler
+    {
+    public:
+        typedef std::vector<vcml::u32> callstack; // innermost frame first
+
+    private:
+        mutable std::mutex m_mtx;
+        std::atomic<bool> m_active;
+        std::map<callstack, vcml::u64> m_stacks;
+        vcml::u64 m_num_samples;
+        vcml::u64 m_num_other;
+        symtab m_symbols;
+
+    public:
+        bool is_active() const { return m_active; }
+
+        profiler();
+        virtual ~profiler();
+
+        vcml::u64 num_samples() const;
+
+        bool load_symbols(const std::string& filename);
+        bool same_function(vcml::u32 a, vcml::u32 b) const;
+
+        void start();
+        void stop();
+        void clear();
+
+        void sample(const callstack& stack);
+        bool write_folded(const std::string& filename) const;
+    };
+
+}
+
+#endif
@@ -0,0 +1,79 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef OR1KMVP_SNAPSHOT_H
+#define OR1KMVP_SNAPSHOT_H
+
+#include "or1kmvp/common.h"
+
+namespace or1kmvp {
+
+    // Tracks which memory pages have been modified since a baseline was
+    // taken. Baseline page contents are copied lazily the first time a page
+    // becomes dirty, so both memory overhead and restore cost scale with the
+    // number of pages touched rather than the size of memory.
+    class snapshot
+    {
+    public:
+        typedef std::function<bool(vcml::u64, void*, unsigned int)> reader;
+        typedef std::function<bool(vcml::u64, const void*, unsigned int)>
+            writer;
+
+    private:
+        vcml::range m_mem;
+        vcml::u64   m_page_size;
+        bool        m_active;
+        reader      m_read;
+        writer      m_write;
+
+        std::vector<bool> m_dirty;
+        std::vector<vcml::u64> m_dirty_pages;
+        std::map<vcml::u64, std::vector<vcml::u8>> m_baseline;
+
+        vcml::u64 m_num_restores;
+        vcml::u64 m_num_pages_restored;
+
+    public:
+        bool is_active() const { return m_active; }
+        vcml::u64 page_size() const { return m_page_size; }
+
+        vcml::u64 num_restores() const { return m_num_restores; }
+        vcml::u64 num_pages_restored() const { return m_num_pages_restored; }
+
+        const std::vector<vcml::u64>& dirty_pages() const {
+            return m_dirty_pages;
+        }
+
+        snapshot() = delete;
+        snapshot(const vcml::range& mem, vcml::u64 page_size,
+                 const reader& rd, const writer& wr);
+        virtual ~snapshot();
+
+        vcml::range page_range(vcml::u64 addr) const;
+
+        void activate();
+        void deactivate();
+
+        bool is_dirty(vcml::u64 addr) const;
+        void mark_dirty(vcml::u64 addr);
+        bool restore();
+    };
+
+}
+
+#endif
@@ -0,0 +1,75 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef OR1KMVP_SYMTAB_H
+#define OR1KMVP_SYMTAB_H
+
+#include "or1kmvp/common.h"
+
+namespace or1kmvp {
+
+    // Function symbols read from the symbol table of an ELF32 file, used to
+    // resolve guest addresses to function names. The executable sections are
+    // remembered as well, so that their code can be searched for specific
+    // instructions.
+    class symtab
+    {
+    private:
+        struct symbol {
+            vcml::u32 addr;
+            vcml::u32 size;
+            std::string name;
+
+            bool operator < (const symbol& other) const {
+                return addr < other.addr;
+            }
+        };
+
+        struct section {
+            vcml::u32 addr;
+            vcml::u32 offset;
+            vcml::u32 size;
+        };
+
+        std::string m_filename;
+        bool m_big_endian;
+        std::vector<symbol> m_symbols;
+        std::vector<section> m_code;
+
+        const symbol* containing(vcml::u32 addr) const;
+
+    public:
+        size_t size() const { return m_symbols.size(); }
+        bool empty() const { return m_symbols.empty(); }
+
+        symtab();
+        virtual ~symtab();
+
+        bool load(const std::string& filename);
+
+        const std::string* lookup(vcml::u32 addr) const;
+        vcml::u32 function(vcml::u32 addr) const;
+        std::string name(vcml::u32 addr) const;
+
+        bool find(const std::string& name, vcml::u32& addr) const;
+        std::vector<vcml::u32> scan(vcml::u32 insn) const;
+    };
+
+}
+
+#endif
@@ -21,7 +21,15 @@
 
 #include "or1kmvp/common.h"
 #include "or1kmvp/config.h"
+#include "or1kmvp/checkpoint.h"
+#include "or1kmvp/memory.h"
+#include "or1kmvp/bus_monitor.h"
 #include "or1kmvp/openrisc.h"
+#include "or1kmvp/tracer.h"
+#include "or1kmvp/telemetry.h"
+#include "or1kmvp/virtio_blk.h"
+#include "or1kmvp/virtio_net.h"
+#include "or1kmvp/virtio_console.h"
 
 namespace or1kmvp {
 
@@ -41,6 +49,37 @@ namespace or1kmvp {
         vcml::property<vcml::range>  ompic;
         vcml::property<vcml::range>  hwrng;
         vcml::property<vcml::range>  sdhci;
+        vcml::property<vcml::range>  vblk;
+        vcml::property<vcml::range>  vnet;
+        vcml::property<vcml::range>  vcon;
+
+        vcml::property<std::string>      checkpoint_file;
+        vcml::property<sc_core::sc_time> checkpoint_time;
+        vcml::property<std::string>      restore_file;
+
+        vcml::property<std::string>      trace_file;
+        vcml::property<bool>             trace_delta;
+        vcml::property<bool>             trace_regs;
+
+        vcml::property<bool>             bus_stats;
+        vcml::property<std::string>      irq_latency_file;
+
+        vcml::property<bool>             exclusive_monitor;
+        vcml::property<unsigned int>     exclusive_granule;
+
+        vcml::property<std::string>      telemetry_file;
+        vcml::property<std::string>      telemetry_socket;
+        vcml::property<double>           telemetry_interval;
+
+        vcml::property<bool>             adaptive_quantum;
+        vcml::property<sc_core::sc_time> quantum_min;
+        vcml::property<sc_core::sc_time> quantum_max;
+        vcml::property<unsigned int>     quantum_events;
+
+        vcml::property<bool>             fastforward;
+        vcml::property<sc_core::sc_time> fastforward_quantum;
+        vcml::property<std::string>      fastforward_symbol;
+        vcml::property<unsigned int>     fastforward_nop;
 
         system() = delete;
         system(const sc_core::sc_module_name& name);
@@ -48,15 +87,82 @@ namespace or1kmvp {
 
         virtual int run() override;
 
+        bool save_checkpoint(const std::string& filename);
+        bool load_checkpoint(const std::string& filename);
+
+        bool save_snapshot();
+        bool restore_snapshot();
+
         virtual void end_of_elaboration() override;
 
     private:
+        bool cmd_checkpoint(const std::vector<std::string>& args,
+                            std::ostream& os);
+
+        bool cmd_snapshot(const std::vector<std::string>& args,
+                          std::ostream& os);
+        bool cmd_rewind(const std::vector<std::string>& args,
+                        std::ostream& os);
+
+        bool cmd_busstats(const std::vector<std::string>& args,
+                          std::ostream& os);
+
+        void bind_initiator(vcml::master_socket& socket,
+                            const std::string& name);
+        void report_bus_stats(std::ostream& os) const;
+        void write_irq_latency(const std::string& filename) const;
+        void log_hot_locks() const;
+
+        void checkpoint_thread();
+        void wait_for_cpus();
+
+        vcml::u64 count_sync_events() const;
+        void quantum_thread();
+        void log_quantum_info() const;
+
+        bool read_memory(vcml::u64 addr, void* data, unsigned int size);
+        bool write_memory(vcml::u64 addr, const void* data, unsigned int size);
+
+        void map_mmio(vcml::slave_socket& socket, const vcml::range& addr);
+
+        bool can_checkpoint(std::string& reason);
+
+        void save_state(checkpoint& cp);
+        void load_state(checkpoint& cp);
+
+        void save_cpus(checkpoint& cp);
+        void load_cpus(checkpoint& cp);
+
+        void save_memory(checkpoint& cp);
+        void load_memory(checkpoint& cp);
+
+        void save_registers(checkpoint& cp);
+        void load_registers(checkpoint& cp);
+
+        void save_devices(checkpoint& cp);
+        void load_devices(checkpoint& cp);
+
         std::vector<openrisc*>       m_cpus;
+        tracer*                      m_tracer;
+        telemetry*                   m_telemetry;
+        exmon*                       m_exmon;
+        mmio_table                   m_mmio_table;
+
+        address_map                  m_address_map;
+        std::vector<std::pair<std::string, bus_monitor*>> m_monitors;
+
+        snapshot                     m_snapshot;
+        std::stringstream            m_snapshot_state;
+
+        sc_core::sc_event            m_ff_done;
+
+        vcml::u64                    m_quantum_changes;
+        std::map<sc_core::sc_time, sc_core::sc_time> m_quantum_hist;
 
         vcml::generic::clock         m_clock;
         vcml::generic::reset         m_reset;
         vcml::generic::bus           m_bus;
-        vcml::generic::memory        m_mem;
+        memory                       m_mem;
         vcml::generic::uart8250      m_uart0;
         vcml::generic::uart8250      m_uart1;
         vcml::generic::rtc1742       m_rtc;
@@ -74,6 +180,10 @@ namespace or1kmvp {
         vcml::generic::sdcard        m_sdcard0;
         vcml::generic::sdcard        m_sdcard1;
 
+        virtio_blk                   m_vblk;
+        virtio_net                   m_vnet;
+        virtio_console               m_vcon;
+
         sc_core::sc_signal<clock_t>  m_sig_clock;
         sc_core::sc_signal<bool>     m_sig_reset;
 
@@ -86,6 +196,9 @@ namespace or1kmvp {
         sc_core::sc_signal<bool>     m_irq_ockbd;
         sc_core::sc_signal<bool>     m_irq_ocspi;
         sc_core::sc_signal<bool>     m_irq_sdhci;
+        sc_core::sc_signal<bool>     m_irq_vblk;
+        sc_core::sc_signal<bool>     m_irq_vnet;
+        sc_core::sc_signal<bool>     m_irq_vcon;
 
         std::vector<sc_core::sc_signal<bool>*> m_irq_ompic;
     };
@@ -0,0 +1,68 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef OR1KMVP_TELEMETRY_H
+#define OR1KMVP_TELEMETRY_H
+
+#include "or1kmvp/common.h"
+#include "or1kmvp/openrisc.h"
+
+namespace or1kmvp {
+
+    // Periodically samples the statistics published by each core and makes
+    // them available in Prometheus text format, either by replacing a file
+    // or by answering connections on a local Unix socket. Sampling happens
+    // on a background thread paced by host time, so reports keep coming in
+    // while the simulation is running.
+    class telemetry
+    {
+    private:
+        std::vector<openrisc*> m_cpus;
+        std::string m_file;
+        std::string m_socket;
+        double m_interval;
+        int m_server;
+
+        std::thread m_thread;
+        std::mutex m_mtx;
+        std::condition_variable m_cv;
+        bool m_exit;
+
+        double m_start;
+        double m_last;
+        std::vector<vcml::u64> m_last_insns;
+        std::string m_report;
+
+        void reporter_thread();
+        void sample();
+        void write_file();
+        void serve(double timeout);
+
+    public:
+        telemetry() = delete;
+        telemetry(const std::vector<openrisc*>& cpus, const std::string& file,
+                  const std::string& socket, double interval);
+        virtual ~telemetry();
+
+        void start();
+        void stop();
+    };
+
+}
+
+#endif
@@ -0,0 +1,112 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef OR1KMVP_TRACEFORMAT_H
+#define OR1KMVP_TRACEFORMAT_H
+
+#include <cstdint>
+#include <cstdio>
+
+// Binary instruction trace format, shared by the simulator and the
+// or1kmvp-tracedump decoder. A trace file starts with a header followed by
+// one record per executed basic block, i.e. a run of sequential instructions
+// up to and including the delay slot of the next branch. Register writes are
+// only recorded with trace_regs: the final values of all registers changed
+// by a step follow as separate records (one per register, in ascending
+// order), so intermediate values within a block are not visible. All
+// multi-byte values are stored in little endian byte order.
+//
+// header: "OR1KTRC" '\0', u32 version, u32 flags
+//
+// plain record (no OR1KMVP_TRACE_DELTA flag):
+//   u8 core, u8 reg, u64 cycle, u32 pc, u32 count, u32 value
+//   reg is OR1KMVP_TRACE_NOREG for blocks, which start at pc and retired
+//   count instructions by cycle. Otherwise only value is meaningful:
+//     0..31                   register write
+//     OR1KMVP_TRACE_EXCEPTION exception taken, value holds epcr
+//     OR1KMVP_TRACE_UNTRACED  value instructions of an exception handler
+//                             whose path could not be reconstructed
+//
+// delta record (OR1KMVP_TRACE_DELTA flag):
+//   u8 tag: bits 0..5 core, bit 6 sequential pc, bit 7 non-block record
+//   blocks:
+//     varint cycle delta to the previous block of the same core
+//     varint zigzag pc delta (only if not sequential, i.e. the block does
+//       not start right after the previous block of the same core)
+//     varint count
+//   others:
+//     u8 reg, varint value
+
+#define OR1KMVP_TRACE_MAGIC     "OR1KTRC"
+#define OR1KMVP_TRACE_VERSION   (2)
+#define OR1KMVP_TRACE_DELTA     (1u << 0)
+#define OR1KMVP_TRACE_NOREG     (0xff)
+#define OR1KMVP_TRACE_EXCEPTION (0xfe)
+#define OR1KMVP_TRACE_UNTRACED  (0xfd)
+#define OR1KMVP_TRACE_MAXCORE   (64)
+
+#define OR1KMVP_TRACE_TAG_SEQ (1u << 6)
+#define OR1KMVP_TRACE_TAG_REG (1u << 7)
+
+namespace or1kmvp {
+
+    struct trace_entry {
+        uint64_t cycle;
+        uint32_t pc;
+        uint32_t count;
+        uint32_t value;
+        uint8_t  core;
+        uint8_t  reg;
+    };
+
+    inline size_t trace_put_varint(uint8_t* buf, uint64_t val) {
+        size_t n = 0;
+        while (val >= 0x80) {
+            buf[n++] = (uint8_t)(val | 0x80);
+            val >>= 7;
+        }
+
+        buf[n++] = (uint8_t)val;
+        return n;
+    }
+
+    inline bool trace_get_varint(FILE* f, uint64_t& val) {
+        val = 0;
+        for (unsigned int shift = 0; shift < 64; shift += 7) {
+            int c = fgetc(f);
+            if (c == EOF)
+                return false;
+            val |= (uint64_t)(c & 0x7f) << shift;
+            if (!(c & 0x80))
+                return true;
+        }
+
+        return false;
+    }
+
+    inline uint64_t trace_zigzag(int64_t val) {
+        return ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+    }
+
+    inline int64_t trace_unzigzag(uint64_t val) {
+        return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+    }
+
+}
+
+#endif
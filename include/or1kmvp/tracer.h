@@ -0,0 +1,89 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef OR1KMVP_TRACER_H
+#define OR1KMVP_TRACER_H
+
+#include "or1kmvp/common.h"
+#include "or1kmvp/traceformat.h"
+
+namespace or1kmvp {
+
+    // Collects binary instruction trace records from all cores. Each core
+    // pushes into its own single-producer/single-consumer ring buffer, which
+    // is drained by a background thread that encodes and writes the records,
+    // so the simulation threads never block on file I/O.
+    class tracer
+    {
+    public:
+        class ring
+        {
+        private:
+            std::vector<trace_entry> m_buffer;
+            std::atomic<size_t> m_head;
+            std::atomic<size_t> m_tail;
+
+        public:
+            ring(size_t capacity);
+
+            bool push(const trace_entry& entry);
+            size_t pop(trace_entry* entries, size_t max);
+        };
+
+    private:
+        FILE* m_file;
+        bool m_delta;
+        std::vector<ring*> m_rings;
+        std::vector<trace_entry> m_batch;
+
+        std::thread m_writer;
+        std::mutex m_mtx;
+        std::condition_variable m_cv;
+        std::atomic<bool> m_exit;
+
+        vcml::u64 m_num_records;
+        vcml::u64 m_num_bytes;
+        std::atomic<vcml::u64> m_num_stalls;
+
+        vcml::u64 m_last_cycle[OR1KMVP_TRACE_MAXCORE];
+        vcml::u32 m_last_pc[OR1KMVP_TRACE_MAXCORE];
+
+        void writer_thread();
+        bool drain();
+        void encode(const trace_entry& entry);
+
+    public:
+        vcml::u64 num_records() const { return m_num_records; }
+        vcml::u64 num_bytes() const { return m_num_bytes; }
+        vcml::u64 num_stalls() const { return m_num_stalls; }
+
+        tracer() = delete;
+        tracer(const std::string& filename, bool delta);
+        virtual ~tracer();
+
+        bool is_open() const { return m_file != NULL; }
+
+        ring* attach(unsigned int core);
+        void start();
+        void record(ring* r, const trace_entry& entry);
+        void close();
+    };
+
+}
+
+#endif
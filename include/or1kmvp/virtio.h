@@ -0,0 +1,171 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef OR1KMVP_VIRTIO_H
+#define OR1KMVP_VIRTIO_H
+
+#include "or1kmvp/common.h"
+#include "or1kmvp/checkpoint.h"
+
+#define OR1KMVP_VIRTIO_F_INDIRECT_DESC (28)
+#define OR1KMVP_VIRTIO_F_VERSION_1     (32)
+
+namespace or1kmvp {
+
+    // Base for paravirtual devices using the virtio-mmio transport (version
+    // 2) with split virtqueues. Virtqueues and buffers are accessed through
+    // the OUT socket, using DMI whenever possible, so that devices can move
+    // data straight from and into guest memory. Requests are handled as soon
+    // as the driver writes QueueNotify, all pending ones at once.
+    class virtio_mmio: public vcml::peripheral
+    {
+    public:
+        struct buffer {
+            vcml::u64 addr;
+            vcml::u32 size;
+        };
+
+        // A descriptor chain taken from the available ring
+        struct request {
+            vcml::u16 head;
+            std::vector<buffer> out; // read by the device
+            std::vector<buffer> in;  // written by the device
+            vcml::u32 length;        // number of bytes written to in
+
+            size_t out_size() const;
+            size_t in_size() const;
+        };
+
+    private:
+        struct virtqueue {
+            vcml::u32 size;
+            bool ready;
+            vcml::u64 desc;
+            vcml::u64 driver;
+            vcml::u64 device;
+            vcml::u16 last_avail;
+            vcml::u16 used;
+        };
+
+        vcml::u32 m_device_id;
+        vcml::u32 m_queue_max;
+        vcml::u64 m_features;
+        vcml::u64 m_driver_features;
+        vcml::u32 m_features_sel;
+        vcml::u32 m_driver_features_sel;
+        vcml::u32 m_queue_sel;
+        vcml::u32 m_irq_status;
+        vcml::u32 m_status;
+        vcml::u32 m_config_gen;
+        std::vector<virtqueue> m_queues;
+        std::vector<vcml::u8> m_config;
+
+        vcml::u64 m_num_notifies;
+        vcml::u64 m_num_requests;
+
+        vcml::u32 read_reg(vcml::u64 offset);
+        void write_reg(vcml::u64 offset, vcml::u32 val);
+        void update_irq();
+        void reset_transport();
+
+        vcml::u16 read16(vcml::u64 addr);
+        vcml::u32 read32(vcml::u64 addr);
+        vcml::u64 read64(vcml::u64 addr);
+        void write16(vcml::u64 addr, vcml::u16 val);
+        void write32(vcml::u64 addr, vcml::u32 val);
+
+    protected:
+        vcml::u8* dma_ptr(vcml::u64 addr, vcml::u32 size, bool write);
+        bool dma_read(vcml::u64 addr, void* data, vcml::u32 size);
+        bool dma_write(vcml::u64 addr, const void* data, vcml::u32 size);
+
+        bool get_request(unsigned int queue, request& req);
+        void unget_request(unsigned int queue);
+        void put_request(unsigned int queue, const request& req);
+        void put_requests(unsigned int queue,
+                          const std::vector<request>& reqs);
+        bool is_queue_ready(unsigned int queue) const;
+
+        size_t copy_out(const request& req, size_t offset, void* data,
+                        size_t size);
+        size_t copy_in(const request& req, size_t offset, const void* data,
+                       size_t size);
+
+        void notify_used(unsigned int queue);
+        void notify_config();
+
+        bool is_driver_ok() const;
+        bool has_feature(unsigned int bit) const;
+
+        void set_features(vcml::u64 features);
+        void set_config(const void* data, size_t size);
+
+        virtual void handle_queue(unsigned int queue) = 0;
+        virtual void write_config(vcml::u64 offset, const void* data,
+                                  unsigned int size);
+        virtual void device_reset();
+
+    public:
+        vcml::slave_socket IN;
+        vcml::master_socket OUT;
+        sc_core::sc_out<bool> IRQ;
+
+        vcml::u64 num_notifies() const { return m_num_notifies; }
+        vcml::u64 num_requests() const { return m_num_requests; }
+
+        virtio_mmio() = delete;
+        virtio_mmio(const sc_core::sc_module_name& name, vcml::u32 devid,
+                    unsigned int queues, vcml::u32 queue_max);
+        virtual ~virtio_mmio();
+
+        virtual void reset() override;
+
+        void save_state(checkpoint& cp);
+        void load_state(checkpoint& cp);
+
+        virtual tlm::tlm_response_status read(const vcml::range& addr,
+                                              void* data,
+                                              const vcml::sideband& info)
+            override;
+        virtual tlm::tlm_response_status write(const vcml::range& addr,
+                                               const void* data,
+                                               const vcml::sideband& info)
+            override;
+    };
+
+    inline vcml::u16 virtio_le16(const vcml::u8* p) {
+        return (vcml::u16)(p[0] | p[1] << 8);
+    }
+
+    inline vcml::u32 virtio_le32(const vcml::u8* p) {
+        return (vcml::u32)p[0] | (vcml::u32)p[1] << 8 |
+               (vcml::u32)p[2] << 16 | (vcml::u32)p[3] << 24;
+    }
+
+    inline vcml::u64 virtio_le64(const vcml::u8* p) {
+        return (vcml::u64)virtio_le32(p) | (vcml::u64)virtio_le32(p + 4) << 32;
+    }
+
+    inline void virtio_put_le(vcml::u8* p, vcml::u64 val, unsigned int n) {
+        for (unsigned int i = 0; i < n; i++)
+            p[i] = (vcml::u8)(val >> (8 * i));
+    }
+
+}
+
+#endif
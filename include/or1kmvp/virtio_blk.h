@@ -0,0 +1,70 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef OR1KMVP_VIRTIO_BLK_H
+#define OR1KMVP_VIRTIO_BLK_H
+
+#include "or1kmvp/common.h"
+#include "or1kmvp/virtio.h"
+
+namespace or1kmvp {
+
+    // Paravirtual block device backed by a raw disk image. Sector data is
+    // read and written with pread/pwrite directly from and into guest memory
+    // whenever it can be reached via DMI, so a request costs a single MMIO
+    // access to notify the device regardless of its size.
+    class virtio_blk: public virtio_mmio
+    {
+    private:
+        int m_fd;
+        vcml::u64 m_capacity;
+
+        vcml::u64 m_num_reads;
+        vcml::u64 m_num_writes;
+        vcml::u64 m_num_flushes;
+        vcml::u64 m_bytes_read;
+        vcml::u64 m_bytes_written;
+
+        void open_image();
+        void update_config();
+
+        vcml::u8 handle_request(const request& req);
+        bool transfer(const std::vector<buffer>& bufs, size_t skip,
+                      size_t size, vcml::u64 pos, bool write);
+        bool transfer(vcml::u64 addr, vcml::u32 size, vcml::u64 pos,
+                      bool write);
+
+    protected:
+        virtual void handle_queue(unsigned int queue) override;
+
+    public:
+        vcml::property<std::string> image;
+        vcml::property<bool> readonly;
+
+        vcml::u64 capacity() const { return m_capacity; }
+
+        virtio_blk() = delete;
+        virtio_blk(const sc_core::sc_module_name& name);
+        virtual ~virtio_blk();
+
+        virtual void end_of_simulation() override;
+    };
+
+}
+
+#endif
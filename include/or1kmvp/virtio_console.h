@@ -0,0 +1,61 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef OR1KMVP_VIRTIO_CONSOLE_H
+#define OR1KMVP_VIRTIO_CONSOLE_H
+
+#include "or1kmvp/common.h"
+#include "or1kmvp/virtio.h"
+
+namespace or1kmvp {
+
+    // Paravirtual console using the same character backends as the UARTs
+    // (tcp, term, stdout, file, ...). Output is collected from all buffers
+    // queued by the driver and handed to the backends with a single write
+    // per notification instead of one access and one write per character.
+    class virtio_console: public virtio_mmio
+    {
+    private:
+        std::vector<vcml::u8> m_tx_buf;
+        std::vector<vcml::u8> m_rx_buf;
+
+        vcml::u64 m_num_tx_batches;
+        vcml::u64 m_bytes_tx;
+        vcml::u64 m_bytes_rx;
+
+        void transmit();
+        void poll();
+
+        void rx_thread();
+
+    protected:
+        virtual void handle_queue(unsigned int queue) override;
+
+    public:
+        vcml::property<sc_core::sc_time> rx_poll;
+
+        virtio_console() = delete;
+        virtio_console(const sc_core::sc_module_name& name);
+        virtual ~virtio_console();
+
+        virtual void end_of_simulation() override;
+    };
+
+}
+
+#endif
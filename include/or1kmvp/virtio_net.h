@@ -0,0 +1,75 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef OR1KMVP_VIRTIO_NET_H
+#define OR1KMVP_VIRTIO_NET_H
+
+#include "or1kmvp/common.h"
+#include "or1kmvp/virtio.h"
+
+namespace or1kmvp {
+
+    // Paravirtual network device using the same frame based backends as the
+    // ethoc (tcp, tap, ...). All frames queued by the driver are sent with
+    // one notification and all frames waiting in the backends are received
+    // with one interrupt. Received frames may be spread across several
+    // buffers if the driver negotiates mergeable receive buffers.
+    class virtio_net: public virtio_mmio
+    {
+    private:
+        vcml::u8 m_mac[6];
+
+        std::vector<vcml::u8> m_tx_frame;
+        std::vector<vcml::u8> m_rx_frame;
+        size_t m_rx_size;
+        std::vector<request> m_rx_reqs;
+
+        vcml::u64 m_num_tx_frames;
+        vcml::u64 m_num_tx_batches;
+        vcml::u64 m_num_rx_frames;
+        vcml::u64 m_num_rx_batches;
+        vcml::u64 m_num_rx_dropped;
+        vcml::u64 m_bytes_tx;
+        vcml::u64 m_bytes_rx;
+
+        void update_config();
+
+        void transmit();
+        bool receive();
+        void poll();
+
+        void rx_thread();
+
+    protected:
+        virtual void handle_queue(unsigned int queue) override;
+        virtual void device_reset() override;
+
+    public:
+        vcml::property<std::string> mac;
+        vcml::property<sc_core::sc_time> rx_poll;
+
+        virtio_net() = delete;
+        virtio_net(const sc_core::sc_module_name& name);
+        virtual ~virtio_net();
+
+        virtual void end_of_simulation() override;
+    };
+
+}
+
+#endif
@@ -0,0 +1,112 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "or1kmvp/bus_monitor.h"
+
+namespace or1kmvp {
+
+    bus_monitor::stats& bus_monitor::lookup(vcml::u64 addr) {
+        for (size_t i = 0; i < m_map.size(); i++)
+            if (m_map[i].second.includes(addr))
+                return m_stats[i];
+        return m_stats.back();
+    }
+
+    void bus_monitor::b_transport(tlm::tlm_generic_payload& tx,
+                                  sc_core::sc_time& t) {
+        stats& s = lookup(tx.get_address());
+        sc_core::sc_time start = t;
+
+        OUT->b_transport(tx, t);
+
+        if (tx.is_write())
+            s.writes++;
+        else
+            s.reads++;
+        s.bytes += tx.get_data_length();
+        if (!tx.is_response_ok())
+            s.errors++;
+        if (tx.is_dmi_allowed())
+            s.dmi_allowed++;
+
+        s.latency.add((vcml::u64)((t - start).to_seconds() * 1e9));
+    }
+
+    bool bus_monitor::get_direct_mem_ptr(tlm::tlm_generic_payload& tx,
+                                         tlm::tlm_dmi& dmi) {
+        bool granted = OUT->get_direct_mem_ptr(tx, dmi);
+        if (granted)
+            lookup(tx.get_address()).dmi_grants++;
+        return granted;
+    }
+
+    unsigned int bus_monitor::transport_dbg(tlm::tlm_generic_payload& tx) {
+        lookup(tx.get_address()).debug++;
+        return OUT->transport_dbg(tx);
+    }
+
+    void bus_monitor::invalidate_direct_mem_ptr(sc_dt::uint64 start,
+                                                sc_dt::uint64 end) {
+        IN->invalidate_direct_mem_ptr(start, end);
+    }
+
+    bus_monitor::bus_monitor(const sc_core::sc_module_name& nm,
+                             const address_map& m):
+        sc_core::sc_module(nm),
+        m_map(m),
+        m_stats(m.size() + 1),
+        IN("IN"),
+        OUT("OUT") {
+        IN.register_b_transport(this, &bus_monitor::b_transport);
+        IN.register_get_direct_mem_ptr(this,
+                                       &bus_monitor::get_direct_mem_ptr);
+        IN.register_transport_dbg(this, &bus_monitor::transport_dbg);
+        OUT.register_invalidate_direct_mem_ptr(this,
+                &bus_monitor::invalidate_direct_mem_ptr);
+    }
+
+    bus_monitor::~bus_monitor() {
+        /* nothing to do */
+    }
+
+    void bus_monitor::clear() {
+        for (stats& s : m_stats)
+            s = stats();
+    }
+
+    void bus_monitor::report(const std::string& initiator,
+                             std::ostream& os) const {
+        for (size_t i = 0; i < m_stats.size(); i++) {
+            const stats& s = m_stats[i];
+            if (s.reads + s.writes + s.dmi_grants + s.debug == 0)
+                continue;
+
+            std::string target = i < m_map.size() ? m_map[i].first : "?";
+            os << vcml::mkstr("%-12s %-8s %10" PRId64 " %10" PRId64
+                              " %12" PRId64 " %6" PRId64 " %8" PRId64
+                              " %6" PRId64 " %8" PRId64 " %8.1f %8" PRId64
+                              " %8" PRId64, initiator.c_str(),
+                              target.c_str(), s.reads, s.writes, s.bytes,
+                              s.errors, s.dmi_allowed, s.dmi_grants,
+                              s.debug, s.latency.mean(),
+                              s.latency.percentile(99.0), s.latency.max())
+               << std::endl;
+        }
+    }
+
+}
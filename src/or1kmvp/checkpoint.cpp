@@ -0,0 +1,55 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "or1kmvp/checkpoint.h"
+
+namespace or1kmvp {
+
+    checkpoint::checkpoint(std::iostream& stream):
+        m_stream(stream) {
+        /* nothing to do */
+    }
+
+    checkpoint::~checkpoint() {
+        /* nothing to do */
+    }
+
+    void checkpoint::write(const void* data, size_t size) {
+        m_stream.write((const char*)data, size);
+    }
+
+    void checkpoint::write(const std::string& str) {
+        write<vcml::u32>(str.length());
+        write(str.c_str(), str.length());
+    }
+
+    void checkpoint::read(void* data, size_t size) {
+        m_stream.read((char*)data, size);
+    }
+
+    std::string checkpoint::read_string() {
+        vcml::u32 len = read<vcml::u32>();
+        if (!good())
+            return "";
+
+        std::string str(len, '\0');
+        read(&str[0], len);
+        return str;
+    }
+
+}
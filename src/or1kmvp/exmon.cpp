@@ -0,0 +1,201 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "or1kmvp/exmon.h"
+
+namespace or1kmvp {
+
+    vcml::u32 exmon::peek(const vcml::u8* ptr, unsigned int size) {
+        vcml::u32 val = 0;
+        memcpy(&val, ptr, std::min(size, (unsigned int)sizeof(val)));
+        return val;
+    }
+
+    bool exmon::swap(vcml::u8* ptr, vcml::u32 expected, const void* data,
+                     unsigned int size) {
+        vcml::u32 val = 0;
+        memcpy(&val, data, std::min(size, (unsigned int)sizeof(val)));
+        if (size == sizeof(val) && ((uintptr_t)ptr % sizeof(val)) == 0) {
+            return __atomic_compare_exchange_n((vcml::u32*)ptr, &expected,
+                                               val, false, __ATOMIC_SEQ_CST,
+                                               __ATOMIC_SEQ_CST);
+        }
+
+        // l.swa is always an aligned word, other sizes are best effort
+        if (peek(ptr, size) != expected)
+            return false;
+        memcpy(ptr, data, size);
+        return true;
+    }
+
+    void exmon::release(unsigned int core) {
+        // must not hold any shard lock
+        reservation& res = m_cores[core];
+        if (!res.valid)
+            return;
+
+        shard& s = lookup(res.granule);
+        std::lock_guard<std::mutex> guard(s.mtx);
+        auto it = s.reserved.find(res.granule);
+        if (it != s.reserved.end() && !(it->second &= ~(1ull << core)))
+            s.reserved.erase(it);
+        res.valid = false;
+    }
+
+    exmon::stats& exmon::record(shard& s, vcml::u64 g) {
+        // must hold the lock of s; only the most contended granules of each
+        // shard are kept, the least contended one makes room for new ones
+        auto it = s.hot.find(g);
+        if (it != s.hot.end())
+            return it->second;
+
+        if (s.hot.size() >= OR1KMVP_EXMON_HOTMAX) {
+            auto victim = s.hot.begin();
+            for (auto cur = s.hot.begin(); cur != s.hot.end(); cur++) {
+                const stats& a = cur->second;
+                const stats& b = victim->second;
+                if (a.num_failed < b.num_failed ||
+                    (a.num_failed == b.num_failed &&
+                     a.num_lwa + a.num_swa < b.num_lwa + b.num_swa))
+                    victim = cur;
+            }
+
+            s.hot.erase(victim);
+        }
+
+        stats& st = s.hot[g];
+        st.addr = g * m_granule;
+        st.num_lwa = st.num_swa = st.num_failed = 0;
+        return st;
+    }
+
+    exmon::exmon(vcml::u64 gran):
+        m_granule(gran == 0 ? 4 : gran),
+        m_shards(),
+        m_cores() {
+        for (reservation& res : m_cores)
+            res.valid = false;
+    }
+
+    exmon::~exmon() {
+        /* nothing to do */
+    }
+
+    void exmon::load(unsigned int core, vcml::u64 addr, const vcml::u8* ptr,
+                     void* data, unsigned int size) {
+        core %= OR1KMVP_EXMON_MAXCORE;
+        vcml::u64 bit = 1ull << core;
+        vcml::u64 g = granule(addr);
+
+        // a core can only hold one reservation at a time
+        reservation& res = m_cores[core];
+        if (res.valid && res.granule != g)
+            release(core);
+
+        shard& s = lookup(g);
+        std::lock_guard<std::mutex> guard(s.mtx);
+        s.reserved[g] |= bit;
+        record(s, g).num_lwa++;
+
+        memcpy(data, ptr, size);
+        res.valid = true;
+        res.granule = g;
+        res.value = peek(ptr, size);
+    }
+
+    bool exmon::store(unsigned int core, vcml::u64 addr, vcml::u8* ptr,
+                      const void* data, unsigned int size) {
+        core %= OR1KMVP_EXMON_MAXCORE;
+        vcml::u64 bit = 1ull << core;
+        vcml::u64 g = granule(addr);
+
+        // a reservation for another granule fails the store and must not
+        // linger in the shard of that granule
+        reservation& res = m_cores[core];
+        if (res.valid && res.granule != g)
+            release(core);
+
+        shard& s = lookup(g);
+        std::lock_guard<std::mutex> guard(s.mtx);
+
+        stats& st = record(s, g);
+        st.num_swa++;
+
+        auto it = s.reserved.find(g);
+        bool held = it != s.reserved.end() && (it->second & bit) &&
+                    res.valid && res.granule == g;
+        res.valid = false;
+
+        // Plain stores of other cores do not take the shard lock, so the
+        // store itself must be a compare-and-swap against the value seen by
+        // the lwa, otherwise e.g. a ticket lock release landing in between
+        // would be overwritten and lost.
+        if (held)
+            held = swap(ptr, res.value, data, size);
+
+        if (!held) {
+            if (it != s.reserved.end() && !(it->second &= ~bit))
+                s.reserved.erase(it);
+            st.num_failed++;
+            return false;
+        }
+
+        s.reserved.erase(it);
+        return true;
+    }
+
+    void exmon::cancel_reservations() {
+        for (shard& s : m_shards) {
+            std::lock_guard<std::mutex> guard(s.mtx);
+            s.reserved.clear();
+        }
+
+        for (reservation& res : m_cores)
+            res.valid = false;
+    }
+
+    void exmon::clear() {
+        cancel_reservations();
+        for (shard& s : m_shards) {
+            std::lock_guard<std::mutex> guard(s.mtx);
+            s.hot.clear();
+        }
+    }
+
+    std::vector<exmon::stats> exmon::hot_locks(size_t max) {
+        std::vector<stats> result;
+        for (shard& s : m_shards) {
+            std::lock_guard<std::mutex> guard(s.mtx);
+            for (auto& it : s.hot)
+                result.push_back(it.second);
+        }
+
+        // most contended first, i.e. by failed stores, then by accesses
+        std::sort(result.begin(), result.end(),
+                  [](const stats& a, const stats& b) -> bool {
+            if (a.num_failed != b.num_failed)
+                return a.num_failed > b.num_failed;
+            return a.num_lwa + a.num_swa > b.num_lwa + b.num_swa;
+        });
+
+        if (result.size() > max)
+            result.resize(max);
+        return result;
+    }
+
+}
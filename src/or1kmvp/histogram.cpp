@@ -0,0 +1,92 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "or1kmvp/histogram.h"
+
+namespace or1kmvp {
+
+    histogram::histogram() {
+        clear();
+    }
+
+    histogram::~histogram() {
+        /* nothing to do */
+    }
+
+    void histogram::clear() {
+        memset(m_buckets, 0, sizeof(m_buckets));
+        m_count = 0;
+        m_sum = 0;
+        m_max = 0;
+    }
+
+    void histogram::merge(const histogram& other) {
+        for (unsigned int i = 0; i < NUM_BUCKETS; i++)
+            m_buckets[i] += other.m_buckets[i];
+        m_count += other.m_count;
+        m_sum += other.m_sum;
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    vcml::u64 histogram::percentile(double p) const {
+        if (m_count == 0)
+            return 0;
+
+        vcml::u64 rank = (vcml::u64)(p / 100.0 * m_count);
+        if (rank >= m_count)
+            rank = m_count - 1;
+
+        vcml::u64 seen = 0;
+        for (unsigned int i = 0; i < NUM_BUCKETS; i++) {
+            seen += m_buckets[i];
+            if (seen > rank)
+                return std::min(bucket_limit(i), m_max);
+        }
+
+        return m_max;
+    }
+
+    vcml::u64 histogram::bucket_limit(unsigned int i) {
+        if (i == 0)
+            return 0;
+        if (i >= 64)
+            return ~0ull;
+        return (1ull << i) - 1;
+    }
+
+    void histogram::write_json(std::ostream& os) const {
+        os << "{ \"count\": " << m_count
+           << ", \"mean\": " << mean()
+           << ", \"max\": " << m_max
+           << ", \"p50\": " << percentile(50.0)
+           << ", \"p99\": " << percentile(99.0)
+           << ", \"p999\": " << percentile(99.9)
+           << ", \"buckets\": [";
+
+        // trailing empty buckets are omitted
+        unsigned int last = 0;
+        for (unsigned int i = 0; i < NUM_BUCKETS; i++)
+            if (m_buckets[i] > 0)
+                last = i + 1;
+
+        for (unsigned int i = 0; i < last; i++)
+            os << (i ? ", " : " ") << m_buckets[i];
+        os << " ] }";
+    }
+
+}
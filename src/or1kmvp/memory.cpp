@@ -0,0 +1,273 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "or1kmvp/memory.h"
+
+namespace or1kmvp {
+
+    bool memory::is_tracking() const {
+        return m_snapshot != NULL && m_snapshot->is_active();
+    }
+
+    void memory::track_access(const vcml::range& addr, bool write,
+                              bool debug) {
+        // Pages are tracked in groups of dirty_granule, so that writing to
+        // neighbouring pages does not revoke DMI from all initiators each
+        // time a page gets upgraded to write access.
+        vcml::u64 pgsz = m_snapshot->page_size();
+        vcml::u64 gsz = pgsz * std::max<vcml::u64>(dirty_granule, 1);
+        for (vcml::u64 ga = addr.start - addr.start % gsz; ga <= addr.end;
+             ga += gsz) {
+            vcml::u64 end = std::min<vcml::u64>(ga + gsz, size) - 1;
+
+            // Contents need to be preserved before they get modified
+            if (write) {
+                for (vcml::u64 pa = ga; pa <= end; pa += pgsz)
+                    m_snapshot->mark_dirty(pa);
+            }
+
+            // Debug accesses never hand out DMI, but debug writes still
+            // have to be tracked.
+            if (debug)
+                continue;
+
+            vcml::vcml_access& granted = m_granted[ga / gsz];
+            vcml::vcml_access access = m_snapshot->is_dirty(ga) ?
+                vcml::VCML_ACCESS_READ_WRITE : vcml::VCML_ACCESS_READ;
+            if (granted == access)
+                continue;
+
+            if (granted != vcml::VCML_ACCESS_NONE)
+                unmap_dmi(ga, end);
+            map_dmi(m_memory + ga, ga, end, access);
+            granted = access;
+        }
+    }
+
+    void memory::allocate() {
+        // Reserve address space only, host pages are populated on first
+        // touch. Mapping over an existing allocation discards its contents
+        // but keeps the host pointer stable for DMI.
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+        if (m_memory != NULL)
+            flags |= MAP_FIXED;
+
+        if (explicit_hugepages && (m_memory == NULL || m_hugetlb)) {
+            const vcml::u64 huge = 2 * 1024 * 1024; // default hugetlb size
+            vcml::u64 length = (size + huge - 1) & ~(huge - 1);
+            void* ptr = mmap(m_memory, length, PROT_READ | PROT_WRITE,
+                             flags | MAP_HUGETLB, -1, 0);
+            if (ptr != MAP_FAILED) {
+                m_memory = (vcml::u8*)ptr;
+                m_length = length;
+                m_hugetlb = true;
+                return;
+            }
+
+            log_warn("hugetlb allocation failed (%s), using normal pages",
+                     strerror(errno));
+        }
+
+        void* ptr = mmap(m_memory, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (ptr == MAP_FAILED)
+            VCML_ERROR("failed to allocate %" PRId64 " bytes of memory: %s",
+                       size.get(), strerror(errno));
+
+        m_memory = (vcml::u8*)ptr;
+        m_length = size;
+
+        if (transparent_hugepages && madvise(m_memory, m_length,
+                                             MADV_HUGEPAGE)) {
+            log_warn("transparent hugepages not available: %s",
+                     strerror(errno));
+        }
+    }
+
+    void memory::load_images() {
+        m_num_mapped = m_num_copied = 0;
+        if (images.get().empty())
+            return;
+
+        std::vector<std::string> list = vcml::split(images, ';');
+        for (std::string entry : list) {
+            entry = vcml::trim(entry);
+            if (entry.empty())
+                continue;
+
+            std::vector<std::string> parts = vcml::split(entry, '@');
+            std::string file = vcml::trim(parts[0]);
+            vcml::u64 offset = parts.size() > 1 ?
+                vcml::from_string<vcml::u64>(vcml::trim(parts[1])) : 0;
+
+            if (map_images && map_image(file, offset))
+                continue;
+
+            if (!copy_image(file, offset))
+                log_warn("failed to load image '%s'", file.c_str());
+        }
+
+        log_debug("loaded images: %" PRId64 " mapped, %" PRId64 " copied",
+                  m_num_mapped, m_num_copied);
+    }
+
+    bool memory::map_image(const std::string& file, vcml::u64 offset) {
+        if (m_hugetlb)
+            return false; // cannot replace parts of a hugetlb mapping
+
+        if (offset % m_host_page)
+            return false; // mmap needs host page aligned offsets
+
+        int fd = open(file.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+            offset + st.st_size > size) {
+            close(fd);
+            return false;
+        }
+
+        // Writes by the guest go to private copies of the affected pages,
+        // the file itself is never modified.
+        void* ptr = mmap(m_memory + offset, st.st_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_FIXED, fd, 0);
+        close(fd);
+
+        if (ptr == MAP_FAILED) {
+            log_debug("cannot map '%s': %s", file.c_str(), strerror(errno));
+            return false;
+        }
+
+        m_num_mapped++;
+        return true;
+    }
+
+    bool memory::copy_image(const std::string& file, vcml::u64 offset) {
+        std::ifstream stream(file.c_str(), std::ios::binary | std::ios::ate);
+        if (!stream.good())
+            return false;
+
+        vcml::u64 length = stream.tellg();
+        if (offset >= size)
+            return false;
+
+        if (offset + length > size) {
+            log_warn("image '%s' exceeds memory size", file.c_str());
+            length = size - offset;
+        }
+
+        stream.seekg(0, std::ios::beg);
+        stream.read((char*)m_memory + offset, length);
+
+        m_num_copied++;
+        return true;
+    }
+
+    memory::memory(const sc_core::sc_module_name& nm, vcml::u64 sz):
+        vcml::peripheral(nm),
+        m_memory(NULL),
+        m_length(0),
+        m_host_page(sysconf(_SC_PAGESIZE)),
+        m_hugetlb(false),
+        m_num_mapped(0),
+        m_num_copied(0),
+        m_snapshot(NULL),
+        m_granted(),
+        size("size", sz),
+        images("images", ""),
+        map_images("map_images", true),
+        transparent_hugepages("transparent_hugepages", false),
+        explicit_hugepages("explicit_hugepages", false),
+        dirty_granule("dirty_granule", 16),
+        IN("IN") {
+        VCML_ERROR_ON(sz == 0, "memory size cannot be zero");
+
+        // images are loaded by reset, which the platform asserts at startup
+        allocate();
+
+        map_dmi(m_memory, 0, size - 1, vcml::VCML_ACCESS_READ_WRITE);
+    }
+
+    memory::~memory() {
+        if (m_memory != NULL)
+            munmap(m_memory, m_length);
+    }
+
+    vcml::u64 memory::touched_pages() const {
+        // Counts host pages currently resident in our mapping. Image pages
+        // still shared with the page cache count as resident, too.
+        std::vector<unsigned char> vec((m_length + m_host_page - 1) /
+                                       m_host_page);
+        if (mincore(m_memory, m_length, vec.data()))
+            return 0;
+
+        vcml::u64 count = 0;
+        for (unsigned char page : vec)
+            count += page & 1;
+        return count;
+    }
+
+    void memory::clear() {
+        // Drops all contents including images, the host pointer (and thus
+        // all DMI pointers) stays the same and pages read as zero again.
+        allocate();
+    }
+
+    void memory::start_tracking() {
+        VCML_ERROR_ON(!is_tracking(), "no active snapshot to track");
+
+        // Revoke all DMI pointers, including those handed out to DMA
+        // capable peripherals, they are granted again page by page.
+        vcml::u64 gsz = m_snapshot->page_size() *
+                        std::max<vcml::u64>(dirty_granule, 1);
+        unmap_dmi(0, size - 1);
+        m_granted.assign((size + gsz - 1) / gsz, vcml::VCML_ACCESS_NONE);
+    }
+
+    void memory::reset() {
+        vcml::peripheral::reset();
+
+        allocate();
+        load_images();
+    }
+
+    tlm::tlm_response_status memory::read(const vcml::range& addr, void* data,
+                                          const vcml::sideband& info) {
+        if (addr.end >= size)
+            return tlm::TLM_ADDRESS_ERROR_RESPONSE;
+
+        memcpy(data, m_memory + addr.start, addr.length());
+        if (is_tracking())
+            track_access(addr, false, info & vcml::SBI_DEBUG);
+        return tlm::TLM_OK_RESPONSE;
+    }
+
+    tlm::tlm_response_status memory::write(const vcml::range& addr,
+                                           const void* data,
+                                           const vcml::sideband& info) {
+        if (addr.end >= size)
+            return tlm::TLM_ADDRESS_ERROR_RESPONSE;
+
+        if (is_tracking())
+            track_access(addr, true, info & vcml::SBI_DEBUG);
+        memcpy(m_memory + addr.start, data, addr.length());
+        return tlm::TLM_OK_RESPONSE;
+    }
+
+}
@@ -18,8 +18,44 @@
 
 #include "or1kmvp/openrisc.h"
 
+#define OR1KMVP_PMR_DME   (1u << 4)  // doze mode enable
+#define OR1KMVP_PMR_SME   (1u << 5)  // sleep mode enable
+
+#define OR1KMVP_TTMR_TP   (0x0fffffffu)
+#define OR1KMVP_TTMR_IE   (1u << 29)
+#define OR1KMVP_TTMR_MODE (3u << 30)
+#define OR1KMVP_TTMR_RST  (1u << 30) // restart after match
+#define OR1KMVP_TTMR_STP  (2u << 30) // stop after match
+
+#define OR1KMVP_INSN_NOP  (0x15000000u) // l.nop, immediate in bits 15..0
+
+#define OR1KMVP_TRACE_NOEPCR (0xffffffffu) // epcr no exception can produce
+
+#define OR1KMVP_SEMIHOST_NOP   (0x5e00) // l.nop 0x5e00 + call number
+#define OR1KMVP_SEMIHOST_PATH  (4096)   // longest host path accepted
+
 namespace or1kmvp {
 
+    enum semihost_call {
+        SEMIHOST_EXIT = 0,   // r3: status
+        SEMIHOST_MEMCPY = 1, // r3: dst, r4: src, r5: size
+        SEMIHOST_MEMSET = 2, // r3: dst, r4: byte, r5: size
+        SEMIHOST_OPEN = 3,   // r3: path, r4: mode (see below)
+        SEMIHOST_CLOSE = 4,  // r3: fd
+        SEMIHOST_READ = 5,   // r3: fd, r4: buf, r5: size
+        SEMIHOST_WRITE = 6,  // r3: fd, r4: buf, r5: size
+        SEMIHOST_SEEK = 7,   // r3: fd, r4: offset, r5: whence
+        SEMIHOST_TIME = 8,   // r11: seconds, r12: microseconds
+        SEMIHOST_NUM_CALLS
+    };
+
+    enum semihost_mode {
+        SEMIHOST_RDONLY = 0,
+        SEMIHOST_WRONLY = 1, // creates or truncates
+        SEMIHOST_APPEND = 2, // creates
+        SEMIHOST_RDWR = 3,
+    };
+
     bool openrisc::cmd_gdb(const std::vector<std::string>& args,
                            std::ostream& os) {
         if (!vcml::file_exists(gdb_term)) {
@@ -110,6 +146,46 @@ namespace or1kmvp {
         return true;
     }
 
+    bool openrisc::cmd_prof(const std::vector<std::string>& args,
+                            std::ostream& os) {
+        if (args[0] == "start") {
+            if (!start_profiling()) {
+                os << "failed to load symbols from " << symbols.str();
+                return false;
+            }
+
+            os << "profiling every " << profile_period << " cycles";
+            return true;
+        }
+
+        if (args[0] == "stop") {
+            m_profiler.stop();
+            os << "profiling stopped after " << m_profiler.num_samples()
+               << " samples";
+            return true;
+        }
+
+        if (args[0] == "clear") {
+            m_profiler.clear();
+            os << "profile cleared";
+            return true;
+        }
+
+        if (args[0] == "dump" && args.size() > 1) {
+            if (!m_profiler.write_folded(args[1])) {
+                os << "failed to write " << args[1];
+                return false;
+            }
+
+            os << m_profiler.num_samples() << " samples written to "
+               << args[1];
+            return true;
+        }
+
+        os << "usage: prof start|stop|clear|dump <file>";
+        return false;
+    }
+
     void openrisc::log_timing_info() const {
         double rt = get_run_time();
         vcml::u64 nc = cycle_count();
@@ -128,6 +204,41 @@ namespace or1kmvp {
         log_info("#lwa          %" PRId64, m_iss->get_num_lwa());
         log_info("#swa          %" PRId64, m_iss->get_num_swa());
         log_info("#swa failed   %" PRId64, m_iss->get_num_swa_failed());
+        log_info("#excl direct  %" PRId64, m_num_excl_fast);
+        log_info("#spin skips   %" PRId64 " (%" PRId64 " cycles)",
+                 m_num_spin_skips, m_spin_skipped);
+        log_info("#semihosting  %" PRId64, m_num_semi_calls);
+        log_info("#kicks        %" PRId64, m_num_kicks);
+        log_info("#slices       %" PRId64 " (%.1f cycles avg)", m_num_slices,
+                 m_num_slices == 0 ? 0.0 : (double)nc / m_num_slices);
+        log_info("#mmio direct  %" PRId64 " of %" PRId64, m_num_mmio_fast,
+                 m_num_mmio);
+        log_info("dmi cache     %" PRId64 " hits, %" PRId64 " negative, %"
+                 PRId64 " misses", m_dmi_hits, m_dmi_neg_hits, m_dmi_misses);
+        log_info("#idle skips   %" PRId64 " (%" PRId64 " cycles)",
+                 m_num_idle_skips, m_idle_skipped);
+
+        if (m_ff_start > 0.0) {
+            double ff = m_ff_active ? vcml::realtime() - m_ff_start
+                                    : m_ff_realtime;
+            vcml::u64 ffinsns = m_ff_active ? insn_count() : m_ff_insns;
+            log_info("fast-forward  %" PRId64 " instructions, %.1f MIPS",
+                     ffinsns, ff == 0.0 ? 0.0 : ffinsns / ff * 1e-6);
+        }
+
+        if (m_ff_start > 0.0 && !m_ff_active) {
+            double det = vcml::realtime() - m_ff_start - m_ff_realtime;
+            vcml::u64 detinsns = insn_count() - m_ff_insns;
+            log_info("detailed      %" PRId64 " instructions, %.1f MIPS",
+                     detinsns, det <= 0.0 ? 0.0 : detinsns / det * 1e-6);
+        }
+
+        if (m_ipi_count > 0) {
+            log_info("ipi latency   %" PRId64 "#, avg %.1fus, max %.1fus",
+                     m_ipi_count,
+                     m_ipi_latency.to_seconds() / m_ipi_count * 1e6,
+                     m_ipi_latency_max.to_seconds() * 1e6);
+        }
 
         for (auto irq : IRQ) {
             vcml::irq_stats stats;
@@ -142,9 +253,40 @@ namespace or1kmvp {
             s += vcml::mkstr(", max %.1fus",
                     stats.irq_longest.to_seconds() * 1e6);
             log_info("%s", s.c_str());
+
+            auto it = m_irq_latency.find(irq.first);
+            if (it == m_irq_latency.end() || it->second.time_ns.count() == 0)
+                continue;
+
+            const histogram& t = it->second.time_ns;
+            const histogram& n = it->second.insns;
+            log_info("irq %d latency p50 %.1fus, p99 %.1fus, p99.9 %.1fus, "
+                     "p99 %" PRId64 " insns", irq.first,
+                     t.percentile(50.0) / 1e3, t.percentile(99.0) / 1e3,
+                     t.percentile(99.9) / 1e3, n.percentile(99.0));
         }
     }
 
+    void openrisc::write_irq_latency(std::ostream& os) const {
+        os << "{";
+        bool first = true;
+        for (auto& it : m_irq_latency) {
+            if (it.second.time_ns.count() == 0)
+                continue;
+
+            os << (first ? "" : ",") << std::endl
+               << "    \"" << it.first << "\": {" << std::endl
+               << "      \"time_ns\": ";
+            it.second.time_ns.write_json(os);
+            os << "," << std::endl << "      \"insns\": ";
+            it.second.insns.write_json(os);
+            os << std::endl << "    }";
+            first = false;
+        }
+
+        os << (first ? "" : "\n  ") << "}";
+    }
+
     using vcml::VCML_ACCESS_READ;
     using vcml::VCML_ACCESS_WRITE;
     using vcml::VCML_ACCESS_READ_WRITE;
@@ -247,14 +389,126 @@ namespace or1kmvp {
 
 #undef SPR
 
+    // Order matters: TLBs and control registers are restored before SR, so
+    // that MMUs and tick timer are only enabled once they are set up.
+    static const std::vector<or1kiss::u32> openrisc_state_sprs = {
+        or1kiss::SPR_EVBAR,  or1kiss::SPR_AECR,  or1kiss::SPR_AESR,
+        or1kiss::SPR_FPCSR,  or1kiss::SPR_EPCR,  or1kiss::SPR_EEAR,
+        or1kiss::SPR_ESR,    or1kiss::SPR_DMMUCR, or1kiss::SPR_IMMUCR,
+        or1kiss::SPR_MACLO,  or1kiss::SPR_MACHI, or1kiss::SPR_PMR,
+        or1kiss::SPR_PICMR,  or1kiss::SPR_PICSR, or1kiss::SPR_TTMR,
+        or1kiss::SPR_TTCR,   or1kiss::SPR_PPC,   or1kiss::SPR_SR,
+        or1kiss::SPR_NPC,
+    };
+
+    static or1kiss::decode_cache_size decode_cache_setting(unsigned int mb) {
+        if (mb == 0)
+            return or1kiss::DECODE_CACHE_OFF;
+        if (mb <= 1)
+            return or1kiss::DECODE_CACHE_SIZE_1M;
+        if (mb <= 2)
+            return or1kiss::DECODE_CACHE_SIZE_2M;
+        if (mb <= 4)
+            return or1kiss::DECODE_CACHE_SIZE_4M;
+        if (mb <= 8)
+            return or1kiss::DECODE_CACHE_SIZE_8M;
+        return or1kiss::DECODE_CACHE_SIZE_16M;
+    }
+
+    // TLB match and translate registers of way 0 (group 1: DMMU, 2: IMMU)
+#define OR1KMVP_TLB_SPR(grp, idx) (((grp) << 11) | (0x200 + (idx)))
+#define OR1KMVP_TLB_NSPR          (0x100)
+
     openrisc::openrisc(const sc_core::sc_module_name& nm, unsigned int id):
         vcml::processor(nm, "or1k"),
         or1kiss::env(or1kiss::ENDIAN_BIG),
         m_iss(NULL),
+        m_num_ipis(0),
+        m_num_mmio(0),
+        m_num_kicks(0),
+        m_num_slices(0),
+        m_ipi_pending(false),
+        m_ipi_raised(),
+        m_ipi_count(0),
+        m_ipi_latency(),
+        m_ipi_latency_max(),
+        m_tracer(NULL),
+        m_trace_ring(NULL),
+        m_trace_regs(false),
+        m_trace_vpage(~0ull),
+        m_trace_ppage(~0ull),
+        m_trace_gpr(),
+        m_trace_blocks(),
+        m_profiler(),
+        m_prof_next(0),
+        m_dmi_cache(),
+        m_dmi_hits(0),
+        m_dmi_neg_hits(0),
+        m_dmi_misses(0),
+        m_irq_latency(),
+        m_pub_insns(0),
+        m_pub_cycles(0),
+        m_pub_sleep(0),
+        m_pub_hit_rate(0.0),
+        m_pub_time(0.0),
+        m_pub_excl(0),
+        m_mmio_table(NULL),
+        m_num_mmio_fast(0),
+        m_exmon(NULL),
+        m_num_excl_fast(0),
+        m_spin_sigs(),
+        m_spin_next(0),
+        m_spin_hits(0),
+        m_num_spin_skips(0),
+        m_spin_skipped(0),
+        m_ff_active(false),
+        m_ff_stop(false),
+        m_ff_markers(),
+        m_ff_notify(),
+        m_ff_start(0.0),
+        m_ff_realtime(0.0),
+        m_ff_insns(0),
+        m_semi_sites(),
+        m_semi_fds({ STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO }),
+        m_num_semi_calls(0),
+        m_exited(false),
+        m_exit_status(0),
+        m_semi_held(~0ull),
+        m_bp_refs(),
+        m_gdb_bps(),
+        m_peers(),
+        m_idle(false),
+        m_idle_cycles(0),
+        m_num_idle_skips(0),
+        m_idle_skipped(0),
+        m_quantum_start(),
+        m_quantum_cycle(),
+        m_quantum_cycles(0),
+        m_worker(),
+        m_worker_mtx(),
+        m_worker_cv(),
+        m_worker_exit(false),
+        m_worker_busy(false),
+        m_work_pending(false),
+        m_work_cycles(0),
+        m_work_result(or1kiss::STEP_OK),
+        m_work_req(NULL),
+        m_work_resp(or1kiss::RESP_SUCCESS),
+        m_work_irqs(),
+        m_work_ipis(),
+        m_work_dmi_stale(false),
         enable_decode_cache("enable_decode_cache", true),
+        decode_cache_size("decode_cache_size", 8),
         enable_sleep_mode("enable_sleep_mode", true),
         enable_insn_dmi("enable_insn_dmi", allow_dmi),
         enable_data_dmi("enable_data_dmi", allow_dmi),
+        enable_parallel("enable_parallel", false),
+        enable_fast_mmio("enable_fast_mmio", true),
+        kick_cycles("kick_cycles", 256),
+        kick_cycles_max("kick_cycles_max", 4096),
+        idle_skip_max("idle_skip_max", sc_core::SC_ZERO_TIME),
+        spin_skip("spin_skip", 8),
+        semihosting("semihosting", false),
         irq_ompic("irq_ompic", OR1KMVP_IRQ_OMPIC),
         irq_uart0("irq_uart0", OR1KMVP_IRQ_UART0),
         irq_uart1("irq_uart1", OR1KMVP_IRQ_UART1),
@@ -263,18 +517,15 @@ namespace or1kmvp {
         irq_ockbd("irq_ockbd", OR1KMVP_IRQ_OCKBD),
         irq_ocspi("irq_ocspi", OR1KMVP_IRQ_OCSPI),
         irq_sdhci("irq_sdhci", OR1KMVP_IRQ_SDHCI),
+        irq_vblk("irq_vblk", OR1KMVP_IRQ_VBLK),
+        irq_vnet("irq_vnet", OR1KMVP_IRQ_VNET),
+        irq_vcon("irq_vcon", OR1KMVP_IRQ_VCON),
+        profile_period("profile_period", 10000),
+        profile_file("profile_file", ""),
         insn_trace_file("insn_trace_file", ""),
         gdb_term("gdb_term", "or1kmvp-gdbterm") {
-        or1kiss::decode_cache_size sz;
-        sz = enable_decode_cache ? or1kiss::DECODE_CACHE_SIZE_8M
-                                 : or1kiss::DECODE_CACHE_OFF;
-
-        m_iss = new or1kiss::or1k(this, sz);
-        m_iss->set_core_id(id);
-        m_iss->allow_sleep(enable_sleep_mode);
-
-        if (!insn_trace_file.get().empty())
-            m_iss->trace(insn_trace_file);
+        m_iss = create_iss(id);
+        trace_flush();
 
         register_command("gdb", 0, this, &openrisc::cmd_gdb,
                          "opens a new gdb debug session");
@@ -282,15 +533,587 @@ namespace or1kmvp {
                          "prints PIC status and pending interrupts");
         register_command("spr", 2, this, &openrisc::cmd_spr,
                          "reads or writes SPR <grpid> <regid> [value]");
+        register_command("prof", 1, this, &openrisc::cmd_prof,
+                         "controls the sampling profiler, use "
+                         "prof start|stop|clear|dump <file>");
 
         set_big_endian();
         define_cpuregs(openrisc_cpuregs);
     }
 
     openrisc::~openrisc() {
+        if (m_worker.joinable()) {
+            std::unique_lock<std::mutex> lock(m_worker_mtx);
+            m_worker_exit = true;
+            m_worker_cv.notify_all();
+            lock.unlock();
+            m_worker.join();
+        }
+
+        for (size_t fd = 3; fd < m_semi_fds.size(); fd++)
+            if (m_semi_fds[fd] >= 0)
+                ::close(m_semi_fds[fd]);
+
         if (m_iss) delete m_iss;
     }
 
+    void openrisc::start_of_simulation() {
+        processor::start_of_simulation();
+        if (m_ff_active)
+            m_ff_start = vcml::realtime();
+        if (!profile_file.get().empty() && !start_profiling())
+            log_warn("failed to load symbols from %s", symbols.str());
+        if (semihosting)
+            start_semihosting();
+    }
+
+    bool openrisc::start_fastforward(const std::string& symbol,
+                                     unsigned int nop,
+                                     std::function<void(void)> notify) {
+        // Markers are implemented as iss breakpoints, so that the core can
+        // run at full speed until it reaches one of them.
+        symtab syms;
+        if (!symbols.get().empty() && !syms.load(symbols))
+            log_warn("failed to load symbols from %s", symbols.str());
+
+        m_ff_markers.clear();
+        if (!symbol.empty()) {
+            vcml::u32 addr;
+            if (syms.find(symbol, addr))
+                m_ff_markers.push_back(addr);
+            else
+                log_warn("fast-forward symbol '%s' not found", symbol.c_str());
+        }
+
+        if (nop != 0) {
+            std::vector<vcml::u32> addrs;
+            addrs = syms.scan(OR1KMVP_INSN_NOP | (nop & 0xffff));
+            m_ff_markers.insert(m_ff_markers.end(), addrs.begin(),
+                                addrs.end());
+        }
+
+        for (vcml::u32 addr : m_ff_markers)
+            ref_breakpoint(addr);
+
+        m_ff_active = true;
+        m_ff_stop = false;
+        m_ff_notify = notify;
+
+        return !m_ff_markers.empty();
+    }
+
+    bool openrisc::leave_fastforward() {
+        // must be called from the SystemC thread while the iss is stopped
+        if (!m_ff_active)
+            return false;
+
+        for (vcml::u32 addr : m_ff_markers)
+            unref_breakpoint(addr);
+
+        m_ff_active = false;
+        m_ff_realtime = vcml::realtime() - m_ff_start;
+        m_ff_insns = insn_count();
+
+        log_info("leaving fast-forward at %s after %" PRId64 " instructions "
+                 "(%.1f MIPS)", sc_core::sc_time_stamp().to_string().c_str(),
+                 m_ff_insns, m_ff_realtime == 0.0 ? 0.0 :
+                 m_ff_insns / m_ff_realtime * 1e-6);
+        return true;
+    }
+
+    void openrisc::ref_breakpoint(vcml::u32 addr) {
+        // Fast-forward markers, semihosting calls and the debugger share
+        // the iss breakpoints, which are only removed once none needs them.
+        if (m_bp_refs[addr]++ == 0)
+            m_iss->insert_breakpoint(addr);
+    }
+
+    void openrisc::unref_breakpoint(vcml::u32 addr) {
+        auto it = m_bp_refs.find(addr);
+        if (it == m_bp_refs.end())
+            return;
+
+        if (--it->second == 0) {
+            m_iss->remove_breakpoint(addr);
+            m_bp_refs.erase(it);
+        }
+    }
+
+    void openrisc::start_semihosting() {
+        // Like the fast-forward markers, the reserved l.nop instructions are
+        // located in the symbol file and turned into iss breakpoints, so the
+        // iss itself does not need to know about them.
+        symtab syms;
+        if (symbols.get().empty() || !syms.load(symbols)) {
+            log_warn("semihosting needs the program in %s", symbols.name());
+            return;
+        }
+
+        for (unsigned int call = 0; call < SEMIHOST_NUM_CALLS; call++) {
+            vcml::u32 insn = OR1KMVP_INSN_NOP | (OR1KMVP_SEMIHOST_NOP + call);
+            for (vcml::u32 addr : syms.scan(insn)) {
+                m_semi_sites[addr] = call;
+                ref_breakpoint(addr);
+            }
+        }
+
+        log_debug("found %zu semihosting calls", m_semi_sites.size());
+    }
+
+    bool openrisc::semihost(or1kiss::step_result& result) {
+        // Called with the core stopped in front of the l.nop, which is
+        // skipped afterwards. Results are returned in r11 (negative errno
+        // on failure), calls take no simulated time.
+        vcml::u32 pc = m_iss->get_spr(or1kiss::SPR_NPC, true);
+        auto it = m_semi_sites.find(pc);
+        if (it == m_semi_sites.end())
+            return false;
+
+        or1kiss::u32* r = m_iss->GPR;
+        vcml::u32 ret = 0;
+        int fd = r[3] < m_semi_fds.size() ? m_semi_fds[r[3]] : -1;
+
+        m_num_semi_calls++;
+        result = or1kiss::STEP_OK;
+
+        switch (it->second) {
+        case SEMIHOST_EXIT:
+            log_info("semihosting exit with status %d", (int)r[3]);
+            m_exit_status = (int)r[3];
+            m_exited = true;
+            result = or1kiss::STEP_EXIT;
+            break;
+
+        case SEMIHOST_MEMCPY:
+            ret = semihost_memcpy(r[3], r[4], r[5]) ? r[3] : -EFAULT;
+            break;
+
+        case SEMIHOST_MEMSET:
+            ret = semihost_memset(r[3], r[4], r[5]) ? r[3] : -EFAULT;
+            break;
+
+        case SEMIHOST_OPEN: {
+            static const int flags[] = {
+                O_RDONLY,
+                O_WRONLY | O_CREAT | O_TRUNC,
+                O_WRONLY | O_CREAT | O_APPEND,
+                O_RDWR | O_CREAT,
+            };
+
+            std::string path;
+            if (!semihost_string(r[3], path)) {
+                ret = -EFAULT;
+                break;
+            }
+
+            fd = ::open(path.c_str(), flags[r[4] & 3], 0644);
+            if (fd < 0) {
+                ret = -errno;
+                break;
+            }
+
+            // reuse the lowest closed descriptor, like the host would
+            ret = 3;
+            while (ret < m_semi_fds.size() && m_semi_fds[ret] >= 0)
+                ret++;
+
+            if (ret < m_semi_fds.size())
+                m_semi_fds[ret] = fd;
+            else
+                m_semi_fds.push_back(fd);
+            break;
+        }
+
+        case SEMIHOST_CLOSE:
+            if (fd < 0) {
+                ret = -EBADF;
+                break;
+            }
+
+            if (r[3] > 2) { // keep the host stdio open
+                ::close(fd);
+                m_semi_fds[r[3]] = -1;
+            }
+            break;
+
+        case SEMIHOST_READ:
+        case SEMIHOST_WRITE:
+            if (fd < 0) {
+                ret = -EBADF;
+                break;
+            }
+
+            ret = semihost_io(fd, r[4], r[5], it->second == SEMIHOST_WRITE);
+            break;
+
+        case SEMIHOST_SEEK: {
+            if (fd < 0) {
+                ret = -EBADF;
+                break;
+            }
+
+            off_t off = ::lseek(fd, (vcml::i32)r[4], r[5]);
+            ret = off < 0 ? -errno : off;
+            break;
+        }
+
+        case SEMIHOST_TIME: {
+            struct timeval tv;
+            gettimeofday(&tv, NULL);
+            ret = tv.tv_sec;
+            r[12] = tv.tv_usec;
+            break;
+        }
+
+        default:
+            ret = -ENOSYS;
+            break;
+        }
+
+        r[11] = ret;
+        m_iss->set_spr(or1kiss::SPR_NPC, pc + 4, true);
+        return true;
+    }
+
+    bool openrisc::semihost_translate(vcml::u32 va, vcml::u32& pa,
+                                      bool write) {
+        pa = va;
+        if (!m_iss->is_dmmu_active())
+            return true;
+
+        or1kiss::request req;
+        req.set_dmem();
+        if (write)
+            req.set_write();
+        else
+            req.set_read();
+        req.set_debug();
+        req.addr = va;
+
+        if (m_iss->get_dmmu()->translate(req) != or1kiss::MMU_OKAY)
+            return false;
+
+        pa = req.addr;
+        return true;
+    }
+
+    vcml::u8* openrisc::semihost_ptr(vcml::u32 va, vcml::u32 size,
+                                     bool write) {
+        // va .. va + size - 1 must not cross a page boundary
+        vcml::u32 pa;
+        if (!semihost_translate(va, pa, write))
+            return NULL;
+
+        vcml::u8* ptr = get_data_ptr(pa);
+        if (ptr == NULL || get_data_ptr(pa + size - 1) == NULL)
+            return NULL;
+
+        return ptr;
+    }
+
+    bool openrisc::semihost_copy(vcml::u32 va, void* buf, vcml::u32 size,
+                                 bool write) {
+        vcml::u8* data = (vcml::u8*)buf;
+        while (size > 0) {
+            vcml::u32 n = OR1KISS_PAGE_SIZE - va % OR1KISS_PAGE_SIZE;
+            n = std::min(n, size);
+
+            vcml::u8* ptr = semihost_ptr(va, n, write);
+            if (ptr != NULL) {
+                memcpy(write ? ptr : data, write ? data : ptr, n);
+            } else {
+                // no DMI yet, use a debug access that may also grant it
+                vcml::u32 pa;
+                if (!semihost_translate(va, pa, write))
+                    return false;
+
+                or1kiss::request req;
+                req.set_dmem();
+                if (write)
+                    req.set_write();
+                else
+                    req.set_read();
+                req.set_debug();
+                req.addr = pa;
+                req.data = data;
+                req.size = n;
+
+                if (transact(req) != or1kiss::RESP_SUCCESS)
+                    return false;
+            }
+
+            va += n;
+            data += n;
+            size -= n;
+        }
+
+        return true;
+    }
+
+    bool openrisc::semihost_memcpy(vcml::u32 dst, vcml::u32 src,
+                                   vcml::u32 size) {
+        // Copies page by page, starting from the end if the destination
+        // overlaps the source from above, so that memmove semantics hold
+        // across chunks as well.
+        bool backwards = dst > src && dst - src < size;
+        vcml::u8 buf[OR1KISS_PAGE_SIZE];
+        while (size > 0) {
+            vcml::u32 n, d_addr, s_addr;
+            if (backwards) {
+                n = std::min(size, std::min(
+                    (dst + size - 1) % OR1KISS_PAGE_SIZE + 1,
+                    (src + size - 1) % OR1KISS_PAGE_SIZE + 1));
+                d_addr = dst + size - n;
+                s_addr = src + size - n;
+            } else {
+                n = std::min(size, std::min(
+                    OR1KISS_PAGE_SIZE - dst % OR1KISS_PAGE_SIZE,
+                    OR1KISS_PAGE_SIZE - src % OR1KISS_PAGE_SIZE));
+                d_addr = dst;
+                s_addr = src;
+                dst += n;
+                src += n;
+            }
+
+            vcml::u8* d = semihost_ptr(d_addr, n, true);
+            vcml::u8* s = semihost_ptr(s_addr, n, false);
+            if (d != NULL && s != NULL) {
+                memmove(d, s, n);
+            } else if (!semihost_copy(s_addr, buf, n, false) ||
+                       !semihost_copy(d_addr, buf, n, true)) {
+                return false;
+            }
+
+            size -= n;
+        }
+
+        return true;
+    }
+
+    bool openrisc::semihost_memset(vcml::u32 dst, vcml::u8 val,
+                                   vcml::u32 size) {
+        vcml::u8 buf[OR1KISS_PAGE_SIZE];
+        memset(buf, val, sizeof(buf));
+
+        while (size > 0) {
+            vcml::u32 n = OR1KISS_PAGE_SIZE - dst % OR1KISS_PAGE_SIZE;
+            n = std::min(n, size);
+
+            vcml::u8* d = semihost_ptr(dst, n, true);
+            if (d != NULL)
+                memset(d, val, n);
+            else if (!semihost_copy(dst, buf, n, true))
+                return false;
+
+            dst += n;
+            size -= n;
+        }
+
+        return true;
+    }
+
+    bool openrisc::semihost_string(vcml::u32 va, std::string& str) {
+        str.clear();
+        while (str.size() < OR1KMVP_SEMIHOST_PATH) {
+            char c;
+            if (!semihost_copy(va++, &c, 1, false))
+                return false;
+            if (c == '\0')
+                return true;
+            str += c;
+        }
+
+        return false;
+    }
+
+    vcml::u32 openrisc::semihost_io(int fd, vcml::u32 va, vcml::u32 size,
+                                    bool write) {
+        // Host I/O goes straight from and into guest memory if it can be
+        // reached via DMI, otherwise it is bounced page by page.
+        vcml::u8 buf[OR1KISS_PAGE_SIZE];
+        vcml::u32 done = 0;
+
+        while (done < size) {
+            vcml::u32 n = OR1KISS_PAGE_SIZE - va % OR1KISS_PAGE_SIZE;
+            n = std::min(n, size - done);
+
+            vcml::u8* ptr = semihost_ptr(va, n, !write);
+            if (ptr == NULL && write && !semihost_copy(va, buf, n, false))
+                return done > 0 ? done : -EFAULT;
+
+            vcml::u8* io = ptr != NULL ? ptr : buf;
+            ssize_t res = write ? ::write(fd, io, n) : ::read(fd, io, n);
+            if (res < 0)
+                return done > 0 ? done : -errno;
+
+            if (ptr == NULL && !write && !semihost_copy(va, buf, res, true))
+                return done > 0 ? done : -EFAULT;
+
+            done += res;
+            va += res;
+
+            if ((vcml::u32)res < n)
+                break; // end of file or short write
+        }
+
+        return done;
+    }
+
+    void openrisc::end_of_simulation() {
+        processor::end_of_simulation();
+        if (profile_file.get().empty() || m_profiler.num_samples() == 0)
+            return;
+
+        if (!m_profiler.write_folded(profile_file))
+            log_warn("failed to write profile to %s", profile_file.str());
+    }
+
+    bool openrisc::is_executing() {
+        std::lock_guard<std::mutex> guard(m_worker_mtx);
+        return m_work_pending;
+    }
+
+    void openrisc::save_state(checkpoint& cp) {
+        for (unsigned int i = 0; i < 32; i++)
+            cp.write<or1kiss::u32>(m_iss->GPR[i]);
+
+        for (unsigned int grp = 1; grp <= 2; grp++) {
+            for (unsigned int i = 0; i < OR1KMVP_TLB_NSPR; i++) {
+                or1kiss::u32 spr = OR1KMVP_TLB_SPR(grp, i);
+                cp.write<or1kiss::u32>(m_iss->get_spr(spr, true));
+            }
+        }
+
+        for (auto spr : openrisc_state_sprs)
+            cp.write<or1kiss::u32>(m_iss->get_spr(spr, true));
+    }
+
+    void openrisc::load_state(checkpoint& cp) {
+        for (unsigned int i = 0; i < 32; i++)
+            m_iss->GPR[i] = cp.read<or1kiss::u32>();
+
+        for (unsigned int grp = 1; grp <= 2; grp++) {
+            for (unsigned int i = 0; i < OR1KMVP_TLB_NSPR; i++) {
+                or1kiss::u32 spr = OR1KMVP_TLB_SPR(grp, i);
+                m_iss->set_spr(spr, cp.read<or1kiss::u32>(), true);
+            }
+        }
+
+        for (auto spr : openrisc_state_sprs)
+            m_iss->set_spr(spr, cp.read<or1kiss::u32>(), true);
+    }
+
+    or1kiss::or1k* openrisc::create_iss(vcml::u64 id) {
+        // decode_cache_size is given in MiB and rounded up to the next
+        // size supported by the iss (1, 2, 4, 8 or 16 MiB)
+        or1kiss::decode_cache_size sz = or1kiss::DECODE_CACHE_OFF;
+        if (enable_decode_cache)
+            sz = decode_cache_setting(decode_cache_size);
+
+        or1kiss::or1k* iss = new or1kiss::or1k(this, sz);
+        iss->set_core_id(id);
+        iss->allow_sleep(enable_sleep_mode);
+
+        if (!insn_trace_file.get().empty())
+            iss->trace(insn_trace_file);
+
+        return iss;
+    }
+
+    void openrisc::flush_decode_cache() {
+        // only call while the iss is not running
+        trace_flush();
+        if (m_iss->get_num_instructions() == 0)
+            return; // nothing decoded since reset
+
+        // The iss cannot drop its decode cache as a whole, so it is replaced
+        // by a new instance taking over the architectural state, clock and
+        // breakpoints. Its counters start from zero again.
+        std::stringstream state;
+        checkpoint cp(state);
+        save_state(cp);
+
+        vcml::u64 id = m_iss->get_core_id();
+        vcml::u64 clock = m_iss->get_clock();
+        delete m_iss;
+
+        m_iss = create_iss(id);
+        m_iss->set_clock(clock);
+        load_state(cp);
+
+        for (auto bp : m_bp_refs)
+            m_iss->insert_breakpoint(bp.first);
+
+        m_prof_next = 0;
+        m_quantum_cycles = 0;
+        publish_stats();
+    }
+
+    void openrisc::flush_decode_cache(const vcml::range& mem) {
+        trace_flush();
+
+        // The decode cache is not aware of memory being changed behind its
+        // back, so invalidate it block-wise as the guest would do.
+        const vcml::u64 bsz = 16;
+        for (vcml::u64 addr = mem.start & ~(bsz - 1); addr <= mem.end;
+             addr += bsz) {
+            m_iss->set_spr(or1kiss::SPR_ICBIR, (or1kiss::u32)addr, true);
+        }
+    }
+
+    void openrisc::invalidate_data_dmi() {
+        set_data_ptr(NULL, 0, 0);
+    }
+
+    bool openrisc::lookup_dmi(bool data, bool write, vcml::u64 addr,
+                              unsigned int size, bool negative,
+                              dmi_entry& result) {
+        // Caches DMI lookups per page, including failed ones, so that MMIO
+        // accesses do not search the socket DMI cache over and over again.
+        // Failures are only cached if the caller has just completed a regular
+        // transaction, which would have filled the socket DMI cache had the
+        // target allowed DMI. Debug accesses never do, so a page touched by
+        // one first must be looked up again later.
+        vcml::u64 page = addr / OR1KISS_PAGE_SIZE;
+        unsigned int kind = data ? (write ? 1 : 2) : 0;
+        dmi_entry& entry = m_dmi_cache[kind]
+                                      [page & (OR1KMVP_DMI_CACHE_SIZE - 1)];
+
+        if (entry.valid && entry.page == page) {
+            if (entry.allowed)
+                m_dmi_hits++;
+            else
+                m_dmi_neg_hits++;
+            result = entry;
+            return entry.allowed && addr + size - 1 <= entry.end;
+        }
+
+        m_dmi_misses++;
+
+        tlm::tlm_dmi dmi;
+        vcml::master_socket& port = data ? DATA : INSN;
+        entry.valid = true;
+        entry.page = page;
+        entry.allowed = port.dmi().lookup(addr, addr + size - 1,
+                                          write ? tlm::TLM_WRITE_COMMAND
+                                                : tlm::TLM_READ_COMMAND, dmi);
+        entry.ptr = dmi.get_dmi_ptr();
+        entry.start = dmi.get_start_address();
+        entry.end = dmi.get_end_address();
+
+        if (!entry.allowed && !negative)
+            entry.valid = false;
+
+        result = entry;
+        return entry.allowed;
+    }
+
+    void openrisc::flush_dmi_cache() {
+        for (auto& cache : m_dmi_cache)
+            for (auto& entry : cache)
+                entry.valid = false;
+    }
+
     void openrisc::reset() {
         memset(m_iss->GPR, 0, sizeof(m_iss->GPR));
         processor::reset();
@@ -299,6 +1122,26 @@ namespace or1kmvp {
         m_iss->reset_instructions();
         m_iss->reset_compiles();
         m_iss->reset_sleep_cycles();
+        m_num_ipis = 0;
+        m_num_mmio = 0;
+        m_num_kicks = 0;
+        m_num_slices = 0;
+        m_dmi_hits = 0;
+        m_dmi_neg_hits = 0;
+        m_dmi_misses = 0;
+        m_num_mmio_fast = 0;
+        m_num_excl_fast = 0;
+        m_num_spin_skips = 0;
+        m_spin_skipped = 0;
+        m_spin_hits = 0;
+        m_irq_latency.clear();
+        flush_dmi_cache();
+        m_num_idle_skips = 0;
+        m_idle_skipped = 0;
+        m_idle = false;
+        m_ipi_count = 0;
+        m_ipi_latency = sc_core::SC_ZERO_TIME;
+        m_ipi_latency_max = sc_core::SC_ZERO_TIME;
         m_iss->set_spr(or1kiss::SPR_NPC, 0x100, true);
     }
 
@@ -335,24 +1178,721 @@ namespace or1kmvp {
         m_iss->set_core_id(id);
     }
 
+    void openrisc::set_tracer(tracer* t, bool regs) {
+        m_tracer = t;
+        m_trace_ring = t->attach(m_iss->get_core_id());
+        m_trace_regs = regs;
+        memcpy(m_trace_gpr, m_iss->GPR, sizeof(m_trace_gpr));
+    }
+
     vcml::u64 openrisc::cycle_count() const {
-        return m_iss->get_num_cycles();
+        return m_iss->get_num_cycles() + m_spin_skipped;
     }
 
-    void openrisc::interrupt(unsigned int irq, bool set) {
+    bool openrisc::is_sleeping() const {
+        if (!enable_sleep_mode)
+            return false;
+
+        or1kiss::u32 pmr = m_iss->get_spr(or1kiss::SPR_PMR, true);
+        return pmr & (OR1KMVP_PMR_DME | OR1KMVP_PMR_SME);
+    }
+
+    vcml::u64 openrisc::cycles_to_tick() const {
+        or1kiss::u32 ttmr = m_iss->get_spr(or1kiss::SPR_TTMR, true);
+        or1kiss::u32 ttcr = m_iss->get_spr(or1kiss::SPR_TTCR, true);
+
+        if (!(ttmr & OR1KMVP_TTMR_IE) || !(ttmr & OR1KMVP_TTMR_MODE))
+            return ~0ull; // timer disabled or not raising interrupts
+
+        or1kiss::u32 period = ttmr & OR1KMVP_TTMR_TP;
+        or1kiss::u32 count = ttcr & OR1KMVP_TTMR_TP;
+        if (count < period)
+            return period - count;
+
+        switch (ttmr & OR1KMVP_TTMR_MODE) {
+        case OR1KMVP_TTMR_RST: return period + 1; // restarts at zero
+        case OR1KMVP_TTMR_STP: return ~0ull; // timer has stopped
+        default: return (OR1KMVP_TTMR_TP - count) + period + 1;
+        }
+    }
+
+    or1kiss::step_result openrisc::step_iss(unsigned int cycles) {
+        if (!m_profiler.is_active() || profile_period == 0u)
+            return step_trace(cycles);
+
+        vcml::u64 limit = m_iss->get_num_cycles() + cycles;
+        or1kiss::step_result result = or1kiss::STEP_OK;
+
+        while (result == or1kiss::STEP_OK) {
+            vcml::u64 now = m_iss->get_num_cycles();
+            if (now >= limit)
+                break;
+
+            if (now >= m_prof_next) {
+                sample_stack();
+                m_prof_next = now + profile_period;
+            }
+
+            result = step_trace(std::min(limit, m_prof_next) - now);
+            if (m_iss->get_num_cycles() == now)
+                break;
+        }
+
+        return result;
+    }
+
+    or1kiss::step_result openrisc::step_trace(unsigned int cycles) {
+        if (m_tracer == NULL)
+            return step_core(cycles);
+
+        // Tracing steps the iss one basic block at a time. Blocks accessing
+        // SPRs are single-stepped, all others run with epcr preset to an
+        // address no exception can leave there, so that exceptions taken
+        // within the block can be told apart. Sleeping cores skip to the
+        // next tick the same way.
+        vcml::u64 limit = m_iss->get_num_cycles() + cycles;
+        or1kiss::step_result result = or1kiss::STEP_OK;
+        m_trace_vpage = ~0ull;
+
+        while (result == or1kiss::STEP_OK) {
+            vcml::u64 now = m_iss->get_num_cycles();
+            if (now >= limit)
+                break;
+
+            vcml::u32 pc = m_iss->get_spr(or1kiss::SPR_NPC, true);
+            unsigned int length = 1;
+            bool safe = true;
+            vcml::u64 n = 0;
+            if (is_sleeping()) {
+                n = std::min(limit - now, cycles_to_tick());
+            } else {
+                safe = trace_scan(pc, length);
+                n = std::min<vcml::u64>(limit - now, safe ? length : 1);
+            }
+
+            or1kiss::u32 epcr = m_iss->get_spr(or1kiss::SPR_EPCR, true);
+            if (safe)
+                m_iss->set_spr(or1kiss::SPR_EPCR, OR1KMVP_TRACE_NOEPCR, true);
+
+            vcml::u64 insns = m_iss->get_num_instructions();
+            result = step_core(n);
+            vcml::u64 retired = m_iss->get_num_instructions() - insns;
+
+            if (!safe) {
+                trace_single(pc, retired);
+            } else {
+                or1kiss::u32 exc = m_iss->get_spr(or1kiss::SPR_EPCR, true);
+                if (exc == OR1KMVP_TRACE_NOEPCR) {
+                    m_iss->set_spr(or1kiss::SPR_EPCR, epcr, true);
+                    if (retired > 0)
+                        trace_record(OR1KMVP_TRACE_NOREG, pc, retired, 0);
+                } else {
+                    trace_exception(pc, retired, exc);
+                }
+            }
+
+            if (retired > 0) {
+                if (m_trace_regs)
+                    trace_gprs();
+            } else if (m_iss->get_num_cycles() == now) {
+                break;
+            }
+        }
+
+        return result;
+    }
+
+    or1kiss::step_result openrisc::step_core(unsigned int cycles) {
+        // Semihosting calls are served where the core stopped and stepping
+        // resumes right after, so they do not end the slice or quantum.
+        vcml::u64 limit = m_iss->get_num_cycles() + cycles;
+        or1kiss::step_result result = m_iss->step(cycles);
+
+        while (result == or1kiss::STEP_BREAKPOINT) {
+            // A debugger breakpoint on a semihosting call is reported first,
+            // the call is served once the core stops there again.
+            vcml::u32 pc = m_iss->get_spr(or1kiss::SPR_NPC, true);
+            if (m_gdb_bps.count(pc) && m_semi_held != pc) {
+                m_semi_held = pc;
+                break;
+            }
+
+            m_semi_held = ~0ull;
+            if (!semihost(result))
+                break;
+
+            vcml::u64 now = m_iss->get_num_cycles();
+            if (result != or1kiss::STEP_OK || now >= limit)
+                break;
+
+            cycles = limit - now;
+            result = m_iss->step(cycles);
+        }
+
+        return result;
+    }
+
+    vcml::u64 openrisc::trace_translate(vcml::u32 pc) {
+        // Translations are cached per page and dropped after exceptions and
+        // single-stepped blocks, which cover context switches and tlb updates.
+        vcml::u64 offset = pc & (OR1KISS_PAGE_SIZE - 1);
+        vcml::u64 vpage = pc - offset;
+        if (vpage != m_trace_vpage) {
+            or1kiss::request req;
+            req.set_imem();
+            req.set_read();
+            req.set_debug();
+            req.addr = vpage;
+
+            m_trace_vpage = vpage;
+            m_trace_ppage = vpage;
+            if (m_iss->is_immu_active()) {
+                or1kiss::mmu* immu = m_iss->get_immu();
+                bool ok = immu->translate(req) == or1kiss::MMU_OKAY;
+                m_trace_ppage = ok ? req.addr : ~0ull;
+            }
+        }
+
+        if (m_trace_ppage == ~0ull)
+            return ~0ull;
+        return m_trace_ppage + offset;
+    }
+
+    bool openrisc::trace_fetch(vcml::u64 addr, or1kiss::u32& insn) {
+        const or1kiss::u8* ptr = get_insn_ptr(addr);
+        if (ptr == NULL)
+            return false;
+
+        insn = (or1kiss::u32)ptr[0] << 24 | ptr[1] << 16 | ptr[2] << 8 | ptr[3];
+        return true;
+    }
+
+    bool openrisc::trace_scan(vcml::u32 pc, unsigned int& length) {
+        // Finds the length of the block starting at pc, up to and including
+        // the delay slot of the next branch. Blocks are cached by physical
+        // address and, like the iss decode cache, only invalidated via
+        // flush_decode_cache or l.mtspr to icbir. Returns false if the block
+        // needs to be single-stepped.
+        length = 1;
+        vcml::u64 addr = trace_translate(pc);
+        if (addr == ~0ull)
+            return false;
+
+        trace_block& block = m_trace_blocks[(addr >> 2) &
+                                            (OR1KMVP_TRACE_BLOCKS - 1)];
+        if (block.addr == addr) {
+            length = block.length;
+            return block.safe;
+        }
+
+        vcml::u64 room = (OR1KISS_PAGE_SIZE - (addr % OR1KISS_PAGE_SIZE)) / 4;
+        vcml::u64 end = std::min<vcml::u64>(room, OR1KMVP_TRACE_MAXBLOCK);
+        unsigned int n = 0;
+        bool safe = true;
+        bool slot = false;
+
+        while (n < end) {
+            or1kiss::u32 insn;
+            if (!trace_fetch(addr + 4 * n, insn))
+                break;
+
+            n++;
+            or1kiss::u32 opcode = insn >> 26;
+            if (opcode == 0x09 || opcode == 0x2d || opcode == 0x30)
+                safe = false; // l.rfe, l.mfspr, l.mtspr
+            if (slot || opcode == 0x08 || opcode == 0x09)
+                break; // delay slot, l.sys, l.trap, l.rfe
+
+            switch (opcode) {
+            case 0x00: // l.j
+            case 0x01: // l.jal
+            case 0x03: // l.bnf
+            case 0x04: // l.bf
+            case 0x11: // l.jr
+            case 0x12: // l.jalr
+                slot = true;
+                safe = safe && n < end;
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        if (n == 0)
+            return false; // not backed by memory, do not cache
+
+        block.addr = addr;
+        block.length = n;
+        block.safe = safe;
+
+        length = n;
+        return safe;
+    }
+
+    void openrisc::trace_flush() {
+        for (trace_block& block : m_trace_blocks)
+            block.addr = ~0ull;
+    }
+
+    void openrisc::trace_single(vcml::u32 pc, vcml::u64 retired) {
+        // Single steps cover l.mtspr, l.mfspr and l.rfe, which may change the
+        // instruction translation or invalidate instruction cache blocks.
+        // The translation cached by trace_scan is still the one for pc.
+        if (retired == 0)
+            return;
+
+        trace_record(OR1KMVP_TRACE_NOREG, pc, retired, 0);
+        vcml::u64 addr = trace_translate(pc);
+        for (vcml::u64 i = 0; i < retired && addr != ~0ull; i++) {
+            or1kiss::u32 insn;
+            if (!trace_fetch(addr + 4 * i, insn) || insn >> 26 != 0x30)
+                continue;
+
+            or1kiss::u32 spr = (insn >> 10 & 0xf800) | (insn & 0x7ff);
+            spr |= m_iss->GPR[insn >> 16 & 0x1f];
+            if (spr == or1kiss::SPR_ICBIR)
+                trace_flush();
+        }
+
+        m_trace_vpage = ~0ull;
+    }
+
+    void openrisc::trace_exception(vcml::u32 pc, vcml::u64 retired,
+                                   or1kiss::u32 epcr) {
+        // Instructions before epcr belong to the interrupted block, the rest
+        // to the handler, which is assumed to have run straight from its
+        // vector. Otherwise only the number of its instructions is recorded.
+        m_trace_vpage = ~0ull;
+
+        vcml::u64 head = 0;
+        if (epcr >= pc)
+            head = std::min<vcml::u64>((epcr - pc) / 4, retired);
+        if (head > 0)
+            trace_record(OR1KMVP_TRACE_NOREG, pc, head, 0);
+
+        trace_record(OR1KMVP_TRACE_EXCEPTION, 0, 0, epcr);
+
+        vcml::u64 tail = retired - head;
+        if (tail == 0)
+            return;
+
+        vcml::u32 npc = m_iss->get_spr(or1kiss::SPR_NPC, true);
+        vcml::u32 evbar = m_iss->get_spr(or1kiss::SPR_EVBAR, true);
+        vcml::u32 vector = npc - 4 * tail;
+        vcml::u32 offset = vector - evbar;
+        if (offset % 0x100 == 0 && offset >= 0x100 && offset < 0x2000)
+            trace_record(OR1KMVP_TRACE_NOREG, vector, tail, 0);
+        else
+            trace_record(OR1KMVP_TRACE_UNTRACED, 0, 0, tail);
+    }
+
+    void openrisc::trace_gprs() {
+        for (unsigned int i = 1; i < 32; i++) {
+            if (m_iss->GPR[i] != m_trace_gpr[i]) {
+                m_trace_gpr[i] = m_iss->GPR[i];
+                trace_record(i, 0, 0, m_trace_gpr[i]);
+            }
+        }
+    }
+
+    void openrisc::trace_record(unsigned int reg, vcml::u32 pc,
+                                vcml::u64 count, or1kiss::u32 value) {
+        trace_entry entry;
+        entry.core = m_iss->get_core_id();
+        entry.cycle = m_iss->get_num_cycles();
+        entry.pc = pc;
+        entry.count = count;
+        entry.value = value;
+        entry.reg = reg;
+        m_tracer->record(m_trace_ring, entry);
+    }
+
+    bool openrisc::read_virt(vcml::u32 va, vcml::u32& val) {
+        vcml::u64 pa = va;
+        if (m_iss->is_dmmu_active()) {
+            or1kiss::request req;
+            req.set_dmem();
+            req.set_read();
+            req.set_debug();
+            req.addr = va;
+
+            if (m_iss->get_dmmu()->translate(req) != or1kiss::MMU_OKAY)
+                return false;
+            pa = req.addr;
+        }
+
+        // Only memory reachable via DMI is read, so that sampling never
+        // causes bus transactions from within the worker thread.
+        const or1kiss::u8* ptr = get_data_ptr(pa);
+        if (ptr == NULL)
+            return false;
+
+        val = (vcml::u32)ptr[0] << 24 | ptr[1] << 16 | ptr[2] << 8 | ptr[3];
+        return true;
+    }
+
+    void openrisc::sample_stack() {
+        // Walks the frame pointer chain: or1k functions with frame pointers
+        // store the return address at fp - 4 and the caller's frame pointer
+        // at fp - 8. Walking stops at the first frame that looks bogus.
+        profiler::callstack stack;
+        vcml::u32 pc = m_iss->get_spr(or1kiss::SPR_NPC, true);
+        stack.push_back(pc);
+
+        // Leaf functions need not set up a frame, their caller is only known
+        // from the link register. It is ignored if it points back into the
+        // sampled function, i.e. that has already called something else.
+        vcml::u32 lr = link_register();
+        bool leaf = lr >= 8 && !(lr & 3) && !m_profiler.same_function(pc,
+                                                                      lr - 8);
+        if (leaf)
+            stack.push_back(lr - 8);
+
+        vcml::u32 fp = m_iss->GPR[2];
+        for (unsigned int depth = 0; depth < 64; depth++) {
+            vcml::u32 ra, prev;
+            if (fp < 8 || !read_virt(fp - 4, ra) || !read_virt(fp - 8, prev))
+                break;
+
+            if (ra < 8 || (ra & 3))
+                break;
+
+            // a non-leaf function saved the link register in its own frame
+            if (!leaf || depth > 0 || ra != lr)
+                stack.push_back(ra - 8); // call site, before the delay slot
+
+            if (prev <= fp)
+                break;
+
+            fp = prev;
+        }
+
+        m_profiler.sample(stack);
+    }
+
+    bool openrisc::start_profiling() {
+        if (!symbols.get().empty() && !m_profiler.load_symbols(symbols))
+            return false;
+
+        m_prof_next = m_iss->get_num_cycles();
+        m_profiler.start();
+        return true;
+    }
+
+    void openrisc::update_idle_state() {
+        // only call while the iss is not running
+        m_idle_cycles = cycles_to_tick();
+        m_idle = is_sleeping();
+    }
+
+    void openrisc::publish_stats() {
+        // only call while the iss is not running
+        // published cycles include those skipped while spinning, just like
+        // cycle_count(), so that telemetry matches the simulated time
+        vcml::u64 cycles = m_iss->get_num_cycles();
+        m_pub_insns = m_iss->get_num_instructions();
+        m_pub_cycles = cycles + m_spin_skipped;
+        m_pub_sleep = m_iss->get_num_sleep_cycles();
+        m_pub_hit_rate = m_iss->get_decode_cache_hit_rate();
+        m_pub_excl = m_iss->get_num_lwa() + m_iss->get_num_swa();
+        m_pub_time = (m_quantum_start + m_quantum_cycle *
+                      (cycles - m_quantum_cycles)).to_seconds();
+    }
+
+    bool openrisc::detect_spin() {
+        // A core whose registers are back in a state seen at one of the last
+        // slice boundaries without any interrupt in between is spinning in a
+        // loop that does not make progress, e.g. waiting for a lock.
+        if (spin_skip == 0u || is_sleeping()) {
+            m_spin_hits = 0;
+            return false;
+        }
+
+        vcml::u64 sig = 14695981039346656037ull; // FNV-1a
+        auto mix = [&sig](or1kiss::u32 val) {
+            sig = (sig ^ val) * 1099511628211ull;
+        };
+
+        mix(m_iss->get_spr(or1kiss::SPR_NPC, true));
+        mix(m_iss->get_spr(or1kiss::SPR_SR, true));
+        for (unsigned int i = 1; i < 32; i++)
+            mix(m_iss->GPR[i]);
+
+        bool seen = std::find(std::begin(m_spin_sigs), std::end(m_spin_sigs),
+                              sig) != std::end(m_spin_sigs);
+        m_spin_sigs[m_spin_next++ % OR1KMVP_SPIN_HISTORY] = sig;
+        m_spin_hits = seen ? m_spin_hits + 1 : 0;
+        return m_spin_hits >= spin_skip;
+    }
+
+    vcml::u64 openrisc::skip_spin(vcml::u64 cycles) {
+        // only call while the iss is not running; the skipped cycles still
+        // count as simulated time, but the tick timer must not pass a match
+        // that the iss would need to raise an interrupt for
+        vcml::u64 tick = cycles_to_tick();
+        if (tick <= cycles)
+            cycles = tick - 1;
+        if (cycles == 0)
+            return 0;
+
+        advance_timer(cycles);
+        m_num_spin_skips++;
+        m_spin_skipped += cycles;
+        return cycles;
+    }
+
+    void openrisc::advance_timer(vcml::u64 cycles) {
+        or1kiss::u32 ttmr = m_iss->get_spr(or1kiss::SPR_TTMR, true);
+        or1kiss::u32 ttcr = m_iss->get_spr(or1kiss::SPR_TTCR, true);
+        if (!(ttmr & OR1KMVP_TTMR_MODE))
+            return; // timer disabled
+
+        vcml::u64 period = ttmr & OR1KMVP_TTMR_TP;
+        vcml::u64 count = (ttcr & OR1KMVP_TTMR_TP) + cycles;
+        switch (ttmr & OR1KMVP_TTMR_MODE) {
+        case OR1KMVP_TTMR_RST:
+            if (count > period)
+                count %= period + 1;
+            break;
+
+        case OR1KMVP_TTMR_STP:
+            if ((ttcr & OR1KMVP_TTMR_TP) <= period)
+                count = std::min(count, period);
+            else
+                count = ttcr & OR1KMVP_TTMR_TP;
+            break;
+
+        default:
+            break;
+        }
+
+        ttcr = (ttcr & ~OR1KMVP_TTMR_TP) | (count & OR1KMVP_TTMR_TP);
+        m_iss->set_spr(or1kiss::SPR_TTCR, ttcr, true);
+    }
+
+    unsigned int openrisc::idle_skip(unsigned int cycles) {
+        // If all cores are asleep, nothing can happen before the next tick
+        // timer match or an external interrupt. Since sleeping cycles are
+        // cheap in the iss, we extend the quantum up to that point, but no
+        // further than idle_skip_max to pick up peripheral interrupts.
+        sc_core::sc_time limit = idle_skip_max;
+        if (limit == sc_core::SC_ZERO_TIME || !is_sleeping())
+            return cycles;
+
+        vcml::u64 target = limit / clock_cycle();
+        target = std::min(target, cycles_to_tick());
+        for (openrisc* peer : m_peers) {
+            if (peer == this)
+                continue;
+            if (!peer->m_idle)
+                return cycles;
+            target = std::min(target, peer->m_idle_cycles.load());
+        }
+
+        if (target <= cycles)
+            return cycles;
+
+        m_num_idle_skips++;
+        m_idle_skipped += target - cycles;
+        return target;
+    }
+
+    void openrisc::worker_thread() {
+        std::unique_lock<std::mutex> lock(m_worker_mtx);
+        while (!m_worker_exit) {
+            if (!m_work_pending) {
+                m_worker_cv.wait(lock);
+                continue;
+            }
+
+            // The quantum is executed in slices of kick_cycles, so that
+            // interrupts raised meanwhile (e.g. IPIs from other cores) are
+            // noticed without waiting for the end of the quantum. While no
+            // interrupts arrive, the slices grow up to kick_cycles_max, so
+            // that the iss spends longer stretches in its dispatch loop.
+            vcml::u64 limit = m_iss->get_num_cycles() + m_work_cycles;
+            or1kiss::step_result result = or1kiss::STEP_OK;
+            unsigned int slice = kick_cycles;
+
+            while (result == or1kiss::STEP_OK) {
+                vcml::u64 done = m_iss->get_num_cycles();
+                if (done >= limit)
+                    break;
+
+                if (!m_work_irqs.empty()) {
+                    if (done > m_quantum_cycles)
+                        m_num_kicks++;
+                    slice = kick_cycles;
+                } else if (done > m_quantum_cycles && detect_spin()) {
+                    // hand the host thread back instead of spinning for
+                    // the rest of the quantum
+                    skip_spin(limit - done);
+                    break;
+                }
+
+                flush_pending();
+                record_ipi_latency();
+
+                unsigned int cycles = limit - done;
+                if (slice > 0 && cycles > slice)
+                    cycles = slice;
+
+                m_worker_busy = true;
+                lock.unlock();
+
+                result = step_iss(cycles);
+                m_num_slices++;
+
+                lock.lock();
+                m_worker_busy = false;
+
+                if (slice < kick_cycles_max)
+                    slice = std::min(slice * 2, kick_cycles_max.get());
+
+                if (m_iss->get_num_cycles() == done)
+                    break; // no progress, hand control back
+            }
+
+            flush_pending();
+            update_idle_state();
+            publish_stats();
+            m_work_result = result;
+            m_work_pending = false;
+            m_worker_cv.notify_all();
+        }
+    }
+
+    void openrisc::drop_stale_dmi() {
+        // must hold m_worker_mtx, the iss may only be waiting for a bus access
+        if (m_work_dmi_stale) {
+            m_work_dmi_stale = false;
+            drop_dmi();
+        }
+    }
+
+    void openrisc::flush_pending() {
+        // must hold m_worker_mtx and the iss must not be running
+        drop_stale_dmi();
+
+        for (auto irq : m_work_irqs)
+            apply_interrupt(irq.first, irq.second);
+        m_work_irqs.clear();
+
+        if (!m_work_ipis.empty()) {
+            m_ipi_raised = m_work_ipis.front();
+            m_ipi_pending = true;
+            m_work_ipis.clear();
+        }
+    }
+
+    void openrisc::apply_interrupt(unsigned int irq, bool set) {
+        // must hold m_worker_mtx and the iss must not be running
         m_iss->interrupt(irq, set);
+        m_spin_hits = 0;
+
+        // Instruction latency counts what the core executed between seeing
+        // the interrupt line go up and go down again (i.e. being acked).
+        irq_latency& lat = m_irq_latency[irq];
+        vcml::u64 insns = m_iss->get_num_instructions();
+        if (set) {
+            lat.applied = true;
+            lat.raise_insns = insns;
+        } else if (lat.applied) {
+            lat.applied = false;
+            lat.insns.add(insns - lat.raise_insns);
+        }
     }
 
-    void openrisc::simulate(unsigned int n) {
-        switch (m_iss->step(n)) {
+    void openrisc::record_ipi_latency() {
+        // must hold m_worker_mtx, called before the iss resumes execution
+        if (!m_ipi_pending)
+            return;
+
+        vcml::u64 cycles = m_iss->get_num_cycles() - m_quantum_cycles;
+        sc_core::sc_time now = m_quantum_start + m_quantum_cycle * cycles;
+        sc_core::sc_time latency = sc_core::SC_ZERO_TIME;
+        if (now > m_ipi_raised)
+            latency = now - m_ipi_raised;
+
+        m_ipi_pending = false;
+        m_ipi_count++;
+        m_ipi_latency += latency;
+        m_ipi_latency_max = std::max(m_ipi_latency_max, latency);
+    }
+
+    void openrisc::simulate_parallel(unsigned int cycles) {
+        if (!m_worker.joinable())
+            m_worker = std::thread(&openrisc::worker_thread, this);
+
+        std::unique_lock<std::mutex> lock(m_worker_mtx);
+        m_quantum_start = local_time_stamp();
+        m_quantum_cycle = clock_cycle();
+        m_quantum_cycles = m_iss->get_num_cycles();
+        m_work_cycles = cycles;
+        m_work_pending = true;
+        m_worker_cv.notify_all();
+        lock.unlock();
+
+        // Let the other cores hand their quantum to their workers before we
+        // block the SystemC kernel waiting for ours to complete.
+        wait(sc_core::SC_ZERO_TIME);
+
+        lock.lock();
+        while (true) {
+            m_worker_cv.wait(lock, [&]() -> bool {
+                return !m_work_pending || m_work_req != NULL;
+            });
+
+            if (m_work_req == NULL)
+                break;
+
+            // Accesses that leave DMI memory are forwarded to the bus from
+            // within the SystemC thread of this processor.
+            const or1kiss::request* req = m_work_req;
+            lock.unlock();
+            or1kiss::response resp = transact_bus(*req);
+            lock.lock();
+
+            m_work_resp = resp;
+            m_work_req = NULL;
+            m_worker_cv.notify_all();
+
+            // Yield after each access, so that the other cores can serve the
+            // bus accesses of their workers (and see IPIs we just raised)
+            // instead of waiting for the end of our quantum.
+            lock.unlock();
+            wait(sc_core::SC_ZERO_TIME);
+            lock.lock();
+        }
+
+        or1kiss::step_result result = m_work_result;
+        lock.unlock();
+
+        handle_step_result(result);
+    }
+
+    void openrisc::handle_step_result(or1kiss::step_result result) {
+        switch (result) {
         case or1kiss::STEP_EXIT:
             sc_core::sc_stop();
             wait();
             break;
 
-        case or1kiss::STEP_BREAKPOINT:
-            notify_breakpoint_hit(program_counter());
+        case or1kiss::STEP_BREAKPOINT: {
+            vcml::u32 pc = program_counter();
+            if (m_ff_active && std::find(m_ff_markers.begin(),
+                m_ff_markers.end(), pc) != m_ff_markers.end()) {
+                log_info("fast-forward marker reached at 0x%08x", pc);
+                leave_fastforward();
+                if (m_ff_notify)
+                    m_ff_notify();
+                break;
+            }
+
+            notify_breakpoint_hit(pc);
             break;
+        }
 
         case or1kiss::STEP_WATCHPOINT: {
             or1kiss::watchpoint_event event;
@@ -372,12 +1912,111 @@ namespace or1kmvp {
         }
     }
 
+    void openrisc::interrupt(unsigned int irq, bool set) {
+        // only needs to synchronize with a worker thread, if there is one
+        std::unique_lock<std::mutex> lock(m_worker_mtx, std::defer_lock);
+        if (m_worker.joinable())
+            lock.lock();
+
+        bool ipi = set && irq == irq_ompic;
+        if (ipi)
+            m_num_ipis++;
+
+        irq_latency& lat = m_irq_latency[irq];
+        sc_core::sc_time now = sc_core::sc_time_stamp();
+        if (set) {
+            lat.raised = true;
+            lat.raise_time = now;
+        } else if (lat.raised) {
+            lat.raised = false;
+            lat.time_ns.add((now - lat.raise_time).to_seconds() * 1e9);
+        }
+
+        if (m_worker_busy) {
+            m_work_irqs.push_back(std::make_pair(irq, set));
+            if (ipi)
+                m_work_ipis.push_back(sc_core::sc_time_stamp());
+        } else {
+            apply_interrupt(irq, set);
+            if (ipi && !m_ipi_pending) {
+                m_ipi_raised = sc_core::sc_time_stamp();
+                m_ipi_pending = true;
+            }
+        }
+    }
+
+    void openrisc::simulate(unsigned int n) {
+        if (m_ff_stop) {
+            m_ff_stop = false;
+            leave_fastforward();
+        }
+
+        n = idle_skip(n);
+
+        if (enable_parallel) {
+            simulate_parallel(n);
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(m_worker_mtx);
+        m_quantum_start = local_time_stamp();
+        m_quantum_cycle = clock_cycle();
+        m_quantum_cycles = m_iss->get_num_cycles();
+        record_ipi_latency();
+        lock.unlock();
+
+        // If the core was spinning at the end of its last quantum, only run
+        // a short probe to see whether it still is before skipping the rest.
+        or1kiss::step_result result = or1kiss::STEP_OK;
+        vcml::u64 limit = m_iss->get_num_cycles() + n;
+        if (spin_skip > 0u && m_spin_hits >= spin_skip && kick_cycles < n) {
+            result = step_iss(kick_cycles);
+            vcml::u64 done = m_iss->get_num_cycles();
+            n = done < limit ? limit - done : 0;
+            if (result == or1kiss::STEP_OK && n > 0 && detect_spin())
+                n -= skip_spin(n);
+        }
+
+        if (result == or1kiss::STEP_OK && n > 0)
+            result = step_iss(n);
+        if (result == or1kiss::STEP_OK)
+            detect_spin();
+
+        update_idle_state();
+        publish_stats();
+        handle_step_result(result);
+    }
+
     void openrisc::handle_clock_update(clock_t oldclk, clock_t newclk) {
         processor::handle_clock_update(oldclk, newclk);
         m_iss->set_clock(newclk);
     }
 
     or1kiss::response openrisc::transact(const or1kiss::request& req) {
+        if (!m_worker.joinable() ||
+            std::this_thread::get_id() != m_worker.get_id())
+            return transact_bus(req);
+
+        // Exclusive accesses to DMI memory do not need the SystemC thread
+        or1kiss::response resp;
+        if (transact_exclusive(req, resp))
+            return resp;
+
+        // Called from the worker thread: hand the request over to the
+        // SystemC thread and sleep until it has been completed. The iss is
+        // in the middle of an instruction, so it stays marked busy and
+        // interrupts remain queued until the next slice boundary. Stale DMI
+        // pointers can go, as for any bus access in sequential mode.
+        std::unique_lock<std::mutex> lock(m_worker_mtx);
+        drop_stale_dmi();
+        m_work_req = &req;
+        m_worker_cv.notify_all();
+        m_worker_cv.wait(lock, [&]() -> bool { return m_work_req == NULL; });
+        drop_stale_dmi();
+        return m_work_resp;
+    }
+
+    or1kiss::response openrisc::transact_bus(const or1kiss::request& req) {
         vcml::sideband info = vcml::SBI_NONE;
         if (req.is_debug())
             info |= vcml::SBI_DEBUG;
@@ -387,16 +2026,38 @@ namespace or1kmvp {
         tlm::tlm_response_status rs;
         vcml::master_socket& port = req.is_imem() ? INSN : DATA;
 
+        if (transact_load(req))
+            return or1kiss::RESP_SUCCESS;
+
         sc_core::sc_time now = local_time_stamp();
 
+        if (req.is_dmem() && !req.is_debug())
+            m_num_mmio++;
+
+        or1kiss::response resp;
+        if (transact_exclusive(req, resp))
+            return resp;
+
+        if (transact_fast(req, rs)) {
+            if (!m_ff_active)
+                req.cycles = (local_time_stamp() - now) / clock_cycle();
+            if (rs != tlm::TLM_OK_RESPONSE) {
+                log_bus_error(port, req.is_read() ? vcml::VCML_ACCESS_READ :
+                              vcml::VCML_ACCESS_WRITE, rs, req.addr, req.size);
+                return or1kiss::RESP_ERROR;
+            }
+
+            return or1kiss::RESP_SUCCESS; // peripherals never grant DMI
+        }
+
         unsigned int nbytes = 0;
         if (req.is_write())
             rs = port.write(req.addr, req.data, req.size, info, &nbytes);
         else
             rs = port.read(req.addr, req.data, req.size, info, &nbytes);
 
-        // Time-keeping
-        if (!req.is_debug())
+        // Time-keeping, skipped while fast-forwarding
+        if (!req.is_debug() && !m_ff_active)
             req.cycles = (local_time_stamp() - now) / clock_cycle();
 
         // Check bus error
@@ -406,24 +2067,22 @@ namespace or1kmvp {
             return or1kiss::RESP_ERROR;
         }
 
-        tlm::tlm_dmi dmi;
+        // The iss also stores through its data pointer, so it only gets one
+        // that grants write access. Pages only granted read access, e.g.
+        // clean pages while a snapshot is tracked, serve loads via
+        // transact_load instead.
+        dmi_entry dmi;
+        bool negative = !req.is_debug();
         if (req.is_dmem() && enable_data_dmi && !get_data_ptr(req.addr)) {
-            if (DATA.dmi().lookup(req.addr, req.addr + req.size - 1,
-                                  tlm::TLM_READ_COMMAND, dmi)) {
-                set_data_ptr(dmi.get_dmi_ptr(),
-                             dmi.get_start_address(),
-                             dmi.get_end_address());
-
-            }
+            if (lookup_dmi(true, true, req.addr, req.size, negative, dmi))
+                set_data_ptr(dmi.ptr, dmi.start, dmi.end);
+            else if (req.is_read())
+                lookup_dmi(true, false, req.addr, req.size, negative, dmi);
         }
 
         if (req.is_imem() && enable_insn_dmi && !get_insn_ptr(req.addr)) {
-            if (INSN.dmi().lookup(req.addr, req.addr + req.size - 1,
-                                  tlm::TLM_READ_COMMAND, dmi)) {
-                set_insn_ptr(dmi.get_dmi_ptr(),
-                             dmi.get_start_address(),
-                             dmi.get_end_address());
-            }
+            if (lookup_dmi(false, false, req.addr, req.size, negative, dmi))
+                set_insn_ptr(dmi.ptr, dmi.start, dmi.end);
         }
 
         if (req.is_exclusive() && (nbytes != req.size))
@@ -431,6 +2090,106 @@ namespace or1kmvp {
         return or1kiss::RESP_SUCCESS;
     }
 
+    bool openrisc::transact_exclusive(const or1kiss::request& req,
+                                      or1kiss::response& resp) {
+        if (m_exmon == NULL || !req.is_exclusive() || !req.is_dmem() ||
+            req.is_debug())
+            return false;
+
+        // Only memory the iss already reaches via DMI is handled here, all
+        // other exclusive accesses still go through the bus.
+        vcml::u8* ptr = get_data_ptr(req.addr);
+        if (ptr == NULL || get_data_ptr(req.addr + req.size - 1) == NULL)
+            return false;
+
+        unsigned int core = m_iss->get_core_id();
+        if (req.is_write()) {
+            bool ok = m_exmon->store(core, req.addr, ptr, req.data, req.size);
+            resp = ok ? or1kiss::RESP_SUCCESS : or1kiss::RESP_FAILED;
+        } else {
+            m_exmon->load(core, req.addr, ptr, req.data, req.size);
+            resp = or1kiss::RESP_SUCCESS;
+        }
+
+        m_num_excl_fast++;
+        return true;
+    }
+
+    bool openrisc::transact_load(const or1kiss::request& req) {
+        // Only consults the read-only DMI cache, which transact_bus fills
+        // after completing a load on the bus.
+        if (!req.is_dmem() || !req.is_read() || req.is_debug() ||
+            req.is_exclusive() || !enable_data_dmi)
+            return false;
+
+        vcml::u64 page = req.addr / OR1KISS_PAGE_SIZE;
+        const dmi_entry& dmi = m_dmi_cache[2]
+                                          [page & (OR1KMVP_DMI_CACHE_SIZE - 1)];
+        if (!dmi.valid || !dmi.allowed || dmi.page != page ||
+            req.addr + req.size - 1 > dmi.end)
+            return false;
+
+        memcpy(req.data, dmi.ptr + (req.addr - dmi.start), req.size);
+        m_dmi_hits++;
+        return true;
+    }
+
+    bool openrisc::transact_fast(const or1kiss::request& req,
+                                 tlm::tlm_response_status& rs) {
+        // Debug and exclusive accesses carry sideband flags in the payload
+        // extensions that a plain b_transport would drop, so those always
+        // go through the bus.
+        if (m_mmio_table == NULL || !enable_fast_mmio || !req.is_dmem() ||
+            req.is_debug() || req.is_exclusive())
+            return false;
+
+        const mmio_target& mmio = (*m_mmio_table)[(req.addr >> 24) & 0xff];
+        if (mmio.target == NULL || !mmio.addr.includes(req.addr) ||
+            !mmio.addr.includes(req.addr + req.size - 1))
+            return false;
+
+        // Same as what the bus would forward, minus the address decoding.
+        tlm::tlm_generic_payload tx;
+        tx.set_command(req.is_write() ? tlm::TLM_WRITE_COMMAND
+                                      : tlm::TLM_READ_COMMAND);
+        tx.set_address(req.addr - mmio.addr.start);
+        tx.set_data_ptr((unsigned char*)req.data);
+        tx.set_data_length(req.size);
+        tx.set_streaming_width(req.size);
+        tx.set_byte_enable_ptr(NULL);
+        tx.set_byte_enable_length(0);
+        tx.set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
+
+        mmio.target->b_transport(tx, local_time());
+        rs = tx.get_response_status();
+
+        m_num_mmio_fast++;
+        return true;
+    }
+
+    void openrisc::drop_dmi() {
+        // the iss must not be running, unless called from within it
+        set_data_ptr(NULL, 0, 0);
+        set_insn_ptr(NULL, 0, 0);
+        flush_dmi_cache();
+    }
+
+    void openrisc::invalidate_direct_mem_ptr(vcml::master_socket* origin,
+                                             vcml::u64 start, vcml::u64 end) {
+        processor::invalidate_direct_mem_ptr(origin, start, end);
+
+        // A busy worker may still be executing from the old pointers, so
+        // they are only dropped at its next slice boundary or bus access.
+        std::unique_lock<std::mutex> lock(m_worker_mtx, std::defer_lock);
+        if (m_worker.joinable())
+            lock.lock();
+
+        if (m_worker_busy)
+            m_work_dmi_stale = true;
+        else
+            drop_dmi();
+    }
+
     bool openrisc::read_reg_dbg(vcml::u64 regno, vcml::u64& val) {
         if (regno < 32)
             val = m_iss->GPR[regno];
@@ -481,7 +2240,8 @@ namespace or1kmvp {
         if (addr > std::numeric_limits<or1kiss::u32>::max())
             return false;
 
-        m_iss->insert_breakpoint((or1kiss::u32)addr);
+        if (m_gdb_bps.insert((vcml::u32)addr).second)
+            ref_breakpoint((vcml::u32)addr);
         return true;
     }
 
@@ -489,7 +2249,8 @@ namespace or1kmvp {
         if (addr > std::numeric_limits<or1kiss::u32>::max())
             return false;
 
-        m_iss->remove_breakpoint((or1kiss::u32)addr);
+        if (m_gdb_bps.erase((vcml::u32)addr))
+            unref_breakpoint((vcml::u32)addr);
         return true;
     }
 
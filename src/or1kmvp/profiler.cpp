@@ -0,0 +1,114 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "or1kmvp/profiler.h"
+
+namespace or1kmvp {
+
+    profiler::profiler():
+        m_mtx(),
+        m_active(false),
+        m_stacks(),
+        m_num_samples(0),
+        m_num_other(0),
+        m_symbols() {
+        /* nothing to do */
+    }
+
+    profiler::~profiler() {
+        /* nothing to do */
+    }
+
+    vcml::u64 profiler::num_samples() const {
+        std::lock_guard<std::mutex> guard(m_mtx);
+        return m_num_samples;
+    }
+
+    bool profiler::load_symbols(const std::string& filename) {
+        std::lock_guard<std::mutex> guard(m_mtx);
+        return m_symbols.load(filename);
+    }
+
+    bool profiler::same_function(vcml::u32 a, vcml::u32 b) const {
+        std::lock_guard<std::mutex> guard(m_mtx);
+        const std::string* sym = m_symbols.lookup(a);
+        return sym != NULL && sym == m_symbols.lookup(b);
+    }
+
+    void profiler::start() {
+        m_active = true;
+    }
+
+    void profiler::stop() {
+        m_active = false;
+    }
+
+    void profiler::clear() {
+        std::lock_guard<std::mutex> guard(m_mtx);
+        m_stacks.clear();
+        m_num_samples = 0;
+        m_num_other = 0;
+    }
+
+    void profiler::sample(const callstack& stack) {
+        std::lock_guard<std::mutex> guard(m_mtx);
+        callstack folded(stack.size());
+        for (size_t i = 0; i < stack.size(); i++)
+            folded[i] = m_symbols.function(stack[i]);
+
+        m_num_samples++;
+        auto it = m_stacks.find(folded);
+        if (it != m_stacks.end())
+            it->second++;
+        else if (m_stacks.size() < OR1KMVP_PROFILE_MAXSTACKS)
+            m_stacks[folded] = 1;
+        else
+            m_num_other++;
+    }
+
+    bool profiler::write_folded(const std::string& filename) const {
+        std::ofstream os(filename.c_str());
+        if (!os.good())
+            return false;
+
+        // Frames without symbol keep their address, but different stacks
+        // may still resolve to the same names.
+        std::lock_guard<std::mutex> guard(m_mtx);
+        std::map<std::string, vcml::u64> folded;
+        for (auto it : m_stacks) {
+            std::stringstream ss;
+            for (auto frame = it.first.rbegin(); frame != it.first.rend();
+                 frame++) {
+                if (frame != it.first.rbegin())
+                    ss << ";";
+                ss << m_symbols.name(*frame);
+            }
+
+            folded[ss.str()] += it.second;
+        }
+
+        if (m_num_other > 0)
+            folded["[other]"] += m_num_other;
+
+        for (auto it : folded)
+            os << it.first << " " << it.second << std::endl;
+
+        return os.good();
+    }
+
+}
@@ -0,0 +1,109 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "or1kmvp/snapshot.h"
+
+namespace or1kmvp {
+
+    snapshot::snapshot(const vcml::range& mem, vcml::u64 page_size,
+                       const reader& rd, const writer& wr):
+        m_mem(mem),
+        m_page_size(page_size),
+        m_active(false),
+        m_read(rd),
+        m_write(wr),
+        m_dirty(),
+        m_dirty_pages(),
+        m_baseline(),
+        m_num_restores(0),
+        m_num_pages_restored(0) {
+        /* nothing to do */
+    }
+
+    snapshot::~snapshot() {
+        /* nothing to do */
+    }
+
+    vcml::range snapshot::page_range(vcml::u64 addr) const {
+        vcml::u64 start = addr - (addr - m_mem.start) % m_page_size;
+        vcml::u64 end = std::min(start + m_page_size - 1, m_mem.end);
+        return vcml::range(start, end);
+    }
+
+    void snapshot::activate() {
+        m_dirty.assign((m_mem.length() + m_page_size - 1) / m_page_size,
+                       false);
+        m_dirty_pages.clear();
+        m_baseline.clear();
+        m_active = true;
+    }
+
+    void snapshot::deactivate() {
+        m_dirty.clear();
+        m_dirty_pages.clear();
+        m_baseline.clear();
+        m_active = false;
+    }
+
+    bool snapshot::is_dirty(vcml::u64 addr) const {
+        if (!m_active || !m_mem.includes(addr))
+            return false;
+        return m_dirty[(addr - m_mem.start) / m_page_size];
+    }
+
+    void snapshot::mark_dirty(vcml::u64 addr) {
+        if (!m_active || !m_mem.includes(addr))
+            return;
+
+        vcml::u64 page = (addr - m_mem.start) / m_page_size;
+        if (m_dirty[page])
+            return;
+
+        m_dirty[page] = true;
+        m_dirty_pages.push_back(page);
+
+        if (m_baseline.count(page))
+            return;
+
+        vcml::range r = page_range(addr);
+        std::vector<vcml::u8>& data = m_baseline[page];
+        data.resize(r.length());
+        if (!m_read(r.start, data.data(), data.size()))
+            VCML_ERROR("failed to read snapshot page at 0x%016" PRIx64,
+                       r.start);
+    }
+
+    bool snapshot::restore() {
+        if (!m_active)
+            return false;
+
+        for (vcml::u64 page : m_dirty_pages) {
+            const std::vector<vcml::u8>& data = m_baseline[page];
+            vcml::u64 addr = m_mem.start + page * m_page_size;
+            if (!m_write(addr, data.data(), data.size()))
+                return false;
+            m_dirty[page] = false;
+        }
+
+        m_num_restores++;
+        m_num_pages_restored += m_dirty_pages.size();
+        m_dirty_pages.clear();
+        return true;
+    }
+
+}
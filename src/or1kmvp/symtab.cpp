@@ -0,0 +1,200 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "or1kmvp/symtab.h"
+
+#define OR1KMVP_ELF_CLASS32 (1)
+#define OR1KMVP_ELF_DATA2LSB (1)
+#define OR1KMVP_ELF_SHT_PROGBITS (1)
+#define OR1KMVP_ELF_SHT_SYMTAB (2)
+#define OR1KMVP_ELF_SHF_EXECINSTR (4)
+#define OR1KMVP_ELF_STT_FUNC (2)
+
+namespace or1kmvp {
+
+    struct elf_reader {
+        std::ifstream& stream;
+        bool big_endian;
+
+        vcml::u32 read(vcml::u64 offset, unsigned int size) {
+            vcml::u8 buf[4] = { 0 };
+            stream.seekg(offset);
+            stream.read((char*)buf, size);
+
+            vcml::u32 val = 0;
+            for (unsigned int i = 0; i < size; i++) {
+                unsigned int shift = big_endian ? size - 1 - i : i;
+                val |= (vcml::u32)buf[i] << (shift * 8);
+            }
+
+            return val;
+        }
+    };
+
+    symtab::symtab():
+        m_filename(),
+        m_big_endian(true),
+        m_symbols(),
+        m_code() {
+        /* nothing to do */
+    }
+
+    symtab::~symtab() {
+        /* nothing to do */
+    }
+
+    bool symtab::load(const std::string& filename) {
+        std::ifstream stream(filename.c_str(), std::ios::binary);
+        if (!stream.good())
+            return false;
+
+        vcml::u8 ident[16];
+        stream.read((char*)ident, sizeof(ident));
+        if (!stream.good() || memcmp(ident, "\x7f" "ELF", 4) != 0 ||
+            ident[4] != OR1KMVP_ELF_CLASS32)
+            return false;
+
+        elf_reader elf = { stream, ident[5] != OR1KMVP_ELF_DATA2LSB };
+        vcml::u32 shoff = elf.read(32, 4);
+        vcml::u32 shentsize = elf.read(46, 2);
+        vcml::u32 shnum = elf.read(48, 2);
+
+        m_filename = filename;
+        m_big_endian = elf.big_endian;
+        m_symbols.clear();
+        m_code.clear();
+        for (vcml::u32 i = 0; i < shnum; i++) {
+            vcml::u64 sh = shoff + i * shentsize;
+            vcml::u32 type = elf.read(sh + 4, 4);
+            if (type == OR1KMVP_ELF_SHT_PROGBITS &&
+                (elf.read(sh + 8, 4) & OR1KMVP_ELF_SHF_EXECINSTR)) {
+                section code;
+                code.addr = elf.read(sh + 12, 4);
+                code.offset = elf.read(sh + 16, 4);
+                code.size = elf.read(sh + 20, 4);
+                m_code.push_back(code);
+            }
+
+            if (type != OR1KMVP_ELF_SHT_SYMTAB)
+                continue;
+
+            vcml::u32 offset = elf.read(sh + 16, 4);
+            vcml::u32 size = elf.read(sh + 20, 4);
+            vcml::u32 link = elf.read(sh + 24, 4);
+            vcml::u32 entsize = elf.read(sh + 36, 4);
+
+            vcml::u64 strsh = shoff + link * shentsize;
+            vcml::u32 stroff = elf.read(strsh + 16, 4);
+            vcml::u32 strsize = elf.read(strsh + 20, 4);
+
+            std::vector<char> strtab(strsize + 1, '\0');
+            stream.seekg(stroff);
+            stream.read(strtab.data(), strsize);
+
+            for (vcml::u32 sym = 0; entsize && sym < size / entsize; sym++) {
+                vcml::u64 ent = offset + sym * entsize;
+                vcml::u32 info = elf.read(ent + 12, 1);
+                if ((info & 0xf) != OR1KMVP_ELF_STT_FUNC)
+                    continue;
+
+                vcml::u32 name = elf.read(ent + 0, 4);
+                if (name >= strsize)
+                    continue;
+
+                symbol s;
+                s.addr = elf.read(ent + 4, 4);
+                s.size = elf.read(ent + 8, 4);
+                s.name = strtab.data() + name;
+                m_symbols.push_back(s);
+            }
+        }
+
+        std::sort(m_symbols.begin(), m_symbols.end());
+        return stream.good() || stream.eof();
+    }
+
+    const symtab::symbol* symtab::containing(vcml::u32 addr) const {
+        symbol key;
+        key.addr = addr;
+        auto it = std::upper_bound(m_symbols.begin(), m_symbols.end(), key);
+        if (it == m_symbols.begin())
+            return NULL;
+
+        --it;
+        if (it->size != 0 && addr >= it->addr + it->size)
+            return NULL;
+
+        return &(*it);
+    }
+
+    const std::string* symtab::lookup(vcml::u32 addr) const {
+        const symbol* sym = containing(addr);
+        return sym != NULL ? &sym->name : NULL;
+    }
+
+    vcml::u32 symtab::function(vcml::u32 addr) const {
+        // start of the function containing addr, addr itself if unknown
+        const symbol* sym = containing(addr);
+        return sym != NULL ? sym->addr : addr;
+    }
+
+    std::string symtab::name(vcml::u32 addr) const {
+        const std::string* sym = lookup(addr);
+        if (sym != NULL)
+            return *sym;
+
+        char buf[16];
+        snprintf(buf, sizeof(buf), "0x%08x", addr);
+        return buf;
+    }
+
+    bool symtab::find(const std::string& name, vcml::u32& addr) const {
+        for (const symbol& sym : m_symbols) {
+            if (sym.name == name) {
+                addr = sym.addr;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    std::vector<vcml::u32> symtab::scan(vcml::u32 insn) const {
+        std::vector<vcml::u32> addrs;
+        std::ifstream stream(m_filename.c_str(), std::ios::binary);
+        for (const section& code : m_code) {
+            std::vector<vcml::u8> buf(code.size);
+            stream.seekg(code.offset);
+            stream.read((char*)buf.data(), buf.size());
+            if (!stream.good())
+                break;
+
+            for (vcml::u32 off = 0; off + 4 <= code.size; off += 4) {
+                const vcml::u8* p = buf.data() + off;
+                vcml::u32 word = 0;
+                for (unsigned int i = 0; i < 4; i++)
+                    word = word << 8 | p[m_big_endian ? i : 3 - i];
+                if (word == insn)
+                    addrs.push_back(code.addr + off);
+            }
+        }
+
+        return addrs;
+    }
+
+}
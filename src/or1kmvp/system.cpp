@@ -18,8 +18,578 @@
 
 #include "or1kmvp/system.h"
 
+#define OR1KMVP_ETHOC_TX_BD_NUM (0x20)      // number of tx descriptors
+#define OR1KMVP_ETHOC_BD_ADDR   (0x400)     // descriptor memory, 8 bytes each
+#define OR1KMVP_ETHOC_BD_COUNT  (128)
+#define OR1KMVP_ETHOC_BD_READY  (1u << 15)  // tx frame waiting to be sent
+
+#define OR1KMVP_SDHCI_PRESENT   (0x24)      // present state register
+#define OR1KMVP_SDHCI_INHIBIT   (3u)        // command or data line in use
+
 namespace or1kmvp {
 
+    static const char* const OR1KMVP_CHECKPOINT_MAGIC = "or1kmvp-checkpoint";
+    static const vcml::u32   OR1KMVP_CHECKPOINT_VERSION = 3;
+
+    static void collect_registers(sc_core::sc_object* obj,
+            std::map<std::string, vcml::property_base*>& regs) {
+        for (sc_core::sc_object* child : obj->get_child_objects()) {
+            vcml::property_base* prop;
+            prop = dynamic_cast<vcml::property_base*>(child);
+            if (prop != NULL && dynamic_cast<vcml::reg_base*>(child) != NULL)
+                regs[child->name()] = prop;
+            collect_registers(child, regs);
+        }
+    }
+
+    bool system::cmd_checkpoint(const std::vector<std::string>& args,
+                                std::ostream& os) {
+        for (auto cpu : m_cpus) {
+            if (cpu->is_executing()) {
+                os << "cannot checkpoint while " << cpu->name()
+                   << " is executing";
+                return false;
+            }
+        }
+
+        std::string reason;
+        if (!can_checkpoint(reason)) {
+            os << "cannot checkpoint: " << reason;
+            return false;
+        }
+
+        if (!save_checkpoint(args[0])) {
+            os << "failed to write checkpoint " << args[0];
+            return false;
+        }
+
+        os << "checkpoint written to " << args[0];
+        return true;
+    }
+
+    bool system::cmd_snapshot(const std::vector<std::string>& args,
+                              std::ostream& os) {
+        if (!save_snapshot()) {
+            os << "cannot take snapshot while processors are executing";
+            return false;
+        }
+
+        os << "snapshot taken at " << sc_core::sc_time_stamp();
+        return true;
+    }
+
+    bool system::cmd_busstats(const std::vector<std::string>& args,
+                              std::ostream& os) {
+        if (m_monitors.empty()) {
+            os << "bus statistics disabled, set " << bus_stats.name()
+               << " = true to enable";
+            return false;
+        }
+
+        if (!args.empty() && args[0] == "clear") {
+            for (auto mon : m_monitors)
+                mon.second->clear();
+            os << "bus statistics cleared";
+            return true;
+        }
+
+        report_bus_stats(os);
+        return true;
+    }
+
+    void system::bind_initiator(vcml::master_socket& socket,
+                                const std::string& name) {
+        if (!bus_stats) {
+            m_bus.bind(socket);
+            return;
+        }
+
+        std::string monitor = "monitor_" + name;
+        std::replace(monitor.begin(), monitor.end(), '.', '_');
+        bus_monitor* mon = new bus_monitor(monitor.c_str(), m_address_map);
+        socket.bind(mon->IN);
+        m_bus.bind(mon->OUT);
+        m_monitors.push_back(std::make_pair(name, mon));
+    }
+
+    void system::report_bus_stats(std::ostream& os) const {
+        os << vcml::mkstr("%-12s %-8s %10s %10s %12s %6s %8s %6s %8s %8s "
+                          "%8s %8s", "initiator", "target", "reads", "writes",
+                          "bytes", "errors", "dmi-able", "grants", "debug",
+                          "avg ns", "p99 ns", "max ns") << std::endl;
+        for (auto mon : m_monitors)
+            mon.second->report(mon.first, os);
+    }
+
+    void system::write_irq_latency(const std::string& filename) const {
+        std::ofstream os(filename.c_str());
+        if (!os.good()) {
+            log_warn("cannot write irq latencies to %s", filename.c_str());
+            return;
+        }
+
+        os << "{";
+        for (size_t i = 0; i < m_cpus.size(); i++) {
+            os << (i ? "," : "") << std::endl
+               << "  \"" << m_cpus[i]->basename() << "\": ";
+            m_cpus[i]->write_irq_latency(os);
+        }
+        os << std::endl << "}" << std::endl;
+    }
+
+    void system::log_hot_locks() const {
+        if (m_exmon == NULL)
+            return;
+
+        std::vector<exmon::stats> locks = m_exmon->hot_locks(8);
+        if (locks.empty() || locks[0].num_failed == 0)
+            return;
+
+        log_info("hot locks          %-12s %10s %10s %10s", "address",
+                 "lwa", "swa", "failed");
+        for (const exmon::stats& lock : locks) {
+            if (lock.num_failed == 0)
+                break;
+            log_info("                   0x%08" PRIx64 "   %10" PRId64
+                     " %10" PRId64 " %10" PRId64, lock.addr, lock.num_lwa,
+                     lock.num_swa, lock.num_failed);
+        }
+    }
+
+    bool system::cmd_rewind(const std::vector<std::string>& args,
+                            std::ostream& os) {
+        if (!m_snapshot.is_active()) {
+            os << "no snapshot has been taken yet";
+            return false;
+        }
+
+        vcml::u64 npages = m_snapshot.dirty_pages().size();
+        if (!restore_snapshot()) {
+            os << "failed to restore snapshot";
+            return false;
+        }
+
+        os << "restored snapshot (" << npages << " dirty pages)";
+        return true;
+    }
+
+    void system::checkpoint_thread() {
+        // wait for the platform to come out of reset
+        wait(sc_core::SC_ZERO_TIME);
+        while (m_sig_reset.read())
+            wait(m_sig_reset.negedge_event());
+
+        if (!restore_file.get().empty()) {
+            wait_for_cpus();
+            if (!load_checkpoint(restore_file))
+                VCML_ERROR("cannot restore %s", restore_file.str());
+        }
+
+        if (checkpoint_file.get().empty())
+            return;
+
+        if (checkpoint_time.get() == sc_core::SC_ZERO_TIME)
+            return; // checkpoint will be requested via command
+
+        sc_core::sc_time now = sc_core::sc_time_stamp();
+        if (checkpoint_time.get() > now)
+            wait(checkpoint_time.get() - now);
+
+        // devices are polled at the largest quantum until they become idle
+        std::string reason;
+        wait_for_cpus();
+        while (!can_checkpoint(reason)) {
+            log_debug("postponing checkpoint: %s", reason.c_str());
+            wait(quantum_max);
+            wait_for_cpus();
+        }
+
+        save_checkpoint(checkpoint_file);
+    }
+
+    void system::wait_for_cpus() {
+        // cores running in parallel mode may still be inside their quantum
+        for (auto cpu : m_cpus) {
+            while (cpu->is_executing())
+                wait(sc_core::SC_ZERO_TIME);
+        }
+    }
+
+    vcml::u64 system::count_sync_events() const {
+        vcml::u64 events = 0;
+        for (auto cpu : m_cpus)
+            events += cpu->ipi_count() + cpu->excl_count() + cpu->mmio_count();
+        return events;
+    }
+
+    void system::quantum_thread() {
+        tlm::tlm_global_quantum& gq = tlm::tlm_global_quantum::instance();
+
+        if (fastforward) {
+            sc_core::sc_time detailed = gq.get();
+            gq.set(fastforward_quantum);
+            wait(m_ff_done);
+            gq.set(detailed);
+            log_info("switched to detailed mode at %s, quantum %s",
+                     sc_core::sc_time_stamp().to_string().c_str(),
+                     detailed.to_string().c_str());
+        }
+
+        if (!adaptive_quantum)
+            return;
+
+        vcml::u64 events = count_sync_events();
+
+        while (true) {
+            sc_core::sc_time quantum = gq.get();
+            wait(quantum);
+            m_quantum_hist[quantum] += quantum;
+
+            // Cores interacting with each other need a small quantum to let
+            // IPIs and lock handovers propagate timely, independent cores
+            // benefit from a large one.
+            vcml::u64 prev = events;
+            events = count_sync_events();
+            vcml::u64 delta = events >= prev ? events - prev : events;
+
+            sc_core::sc_time next = quantum;
+            if (delta >= quantum_events)
+                next = std::max(quantum / 2, quantum_min.get());
+            else if (delta == 0)
+                next = std::min(quantum * 2, quantum_max.get());
+
+            if (next != quantum) {
+                log_debug("quantum changed from %s to %s at %s",
+                          quantum.to_string().c_str(),
+                          next.to_string().c_str(),
+                          sc_core::sc_time_stamp().to_string().c_str());
+                gq.set(next);
+                m_quantum_changes++;
+            }
+        }
+    }
+
+    void system::log_quantum_info() const {
+        if (!adaptive_quantum)
+            return;
+
+        sc_core::sc_time total;
+        for (auto q : m_quantum_hist)
+            total += q.second;
+
+        log_info("quantum changes    %" PRId64, m_quantum_changes);
+        for (auto q : m_quantum_hist) {
+            log_info("quantum %-10s %.1f%%", q.first.to_string().c_str(),
+                     total == sc_core::SC_ZERO_TIME ? 0.0 :
+                     q.second / total * 100.0);
+        }
+    }
+
+    bool system::read_memory(vcml::u64 addr, void* data, unsigned int size) {
+        vcml::master_socket& port = m_cpus[0]->DATA;
+        return port.read(addr, data, size, vcml::SBI_DEBUG) ==
+               tlm::TLM_OK_RESPONSE;
+    }
+
+    bool system::write_memory(vcml::u64 addr, const void* data,
+                              unsigned int size) {
+        vcml::master_socket& port = m_cpus[0]->DATA;
+        return port.write(addr, data, size, vcml::SBI_DEBUG) ==
+               tlm::TLM_OK_RESPONSE;
+    }
+
+    bool system::can_checkpoint(std::string& reason) {
+        // The ethoc descriptors are saved, but neither frames in flight nor
+        // the command or transfer the SD card behind sdhci is processing,
+        // so wait for both to become idle.
+        vcml::u8 buf[4];
+        if (!read_memory(OR1KMVP_ETHOC_ADDR + OR1KMVP_ETHOC_TX_BD_NUM,
+                         buf, sizeof(buf))) {
+            reason = "cannot read ethoc descriptors";
+            return false;
+        }
+
+        vcml::u32 ntx = buf[0] << 24 | buf[1] << 16 | buf[2] << 8 | buf[3];
+        ntx = std::min<vcml::u32>(ntx, OR1KMVP_ETHOC_BD_COUNT);
+        for (vcml::u32 i = 0; i < ntx; i++) {
+            vcml::u64 bd = OR1KMVP_ETHOC_ADDR + OR1KMVP_ETHOC_BD_ADDR + i * 8;
+            if (!read_memory(bd, buf, sizeof(buf))) {
+                reason = "cannot read ethoc descriptors";
+                return false;
+            }
+
+            if ((buf[2] << 8 | buf[3]) & OR1KMVP_ETHOC_BD_READY) {
+                reason = "ethoc transmission pending";
+                return false;
+            }
+        }
+
+        if (!read_memory(OR1KMVP_SDHCI_ADDR + OR1KMVP_SDHCI_PRESENT,
+                         buf, sizeof(buf))) {
+            reason = "cannot read sdhci state";
+            return false;
+        }
+
+        if (buf[0] & OR1KMVP_SDHCI_INHIBIT) {
+            reason = "sdhci command or transfer in progress";
+            return false;
+        }
+
+        return true;
+    }
+
+    void system::save_state(checkpoint& cp) {
+        save_cpus(cp);
+        save_memory(cp);
+        save_registers(cp);
+        save_devices(cp);
+    }
+
+    void system::load_state(checkpoint& cp) {
+        load_cpus(cp);
+        load_memory(cp);
+        load_registers(cp);
+        load_devices(cp);
+    }
+
+    void system::save_cpus(checkpoint& cp) {
+        cp.write<vcml::u32>(m_cpus.size());
+        for (auto cpu : m_cpus)
+            cpu->save_state(cp);
+    }
+
+    void system::load_cpus(checkpoint& cp) {
+        vcml::u32 ncpus = cp.read<vcml::u32>();
+        if (ncpus != m_cpus.size())
+            VCML_ERROR("checkpoint requires %u cpus, have %u", ncpus,
+                       (unsigned int)m_cpus.size());
+
+        for (auto cpu : m_cpus)
+            cpu->load_state(cp);
+    }
+
+    void system::save_memory(checkpoint& cp) {
+        const vcml::range& addr = mem.get();
+        std::vector<vcml::u8> page(OR1KISS_PAGE_SIZE);
+        std::vector<vcml::u8> zero(OR1KISS_PAGE_SIZE, 0);
+
+        cp.write<vcml::u64>(addr.start);
+        cp.write<vcml::u64>(addr.length());
+
+        // only pages holding non-zero data are stored in the checkpoint
+        for (vcml::u64 pa = addr.start; pa <= addr.end; pa += page.size()) {
+            unsigned int size = std::min<vcml::u64>(page.size(),
+                                                    addr.end - pa + 1);
+            if (!read_memory(pa, page.data(), size))
+                VCML_ERROR("failed to read memory at 0x%016" PRIx64, pa);
+            if (memcmp(page.data(), zero.data(), size) == 0)
+                continue;
+
+            cp.write<vcml::u64>(pa - addr.start);
+            cp.write(page.data(), size);
+        }
+
+        cp.write<vcml::u64>(~0ull);
+    }
+
+    void system::load_memory(checkpoint& cp) {
+        const vcml::range& addr = mem.get();
+
+        vcml::u64 start = cp.read<vcml::u64>();
+        vcml::u64 length = cp.read<vcml::u64>();
+        if (start != addr.start || length != addr.length() ||
+            length > m_mem.size)
+            VCML_ERROR("checkpoint memory layout does not match system.mem");
+
+        // Memory is cleared first, so that only the pages stored in the
+        // checkpoint need to be written, directly into the backing store.
+        // All other pages stay unpopulated on the host.
+        m_mem.clear();
+        vcml::u8* host = m_mem.get_data_ptr();
+
+        vcml::u64 offset = cp.read<vcml::u64>();
+        while (offset != ~0ull && cp.good()) {
+            if (offset >= length)
+                VCML_ERROR("invalid checkpoint page at 0x%016" PRIx64,
+                           addr.start + offset);
+
+            cp.read(host + offset, std::min<vcml::u64>(OR1KISS_PAGE_SIZE,
+                                                       length - offset));
+            offset = cp.read<vcml::u64>();
+        }
+
+        for (auto cpu : m_cpus)
+            cpu->flush_decode_cache();
+    }
+
+    void system::save_registers(checkpoint& cp) {
+        std::map<std::string, vcml::property_base*> regs;
+        collect_registers(this, regs);
+
+        cp.write<vcml::u32>(regs.size());
+        for (auto reg : regs) {
+            cp.write(reg.first);
+            cp.write(std::string(reg.second->str()));
+        }
+    }
+
+    void system::load_registers(checkpoint& cp) {
+        std::map<std::string, vcml::property_base*> regs;
+        collect_registers(this, regs);
+
+        vcml::u32 nregs = cp.read<vcml::u32>();
+        for (vcml::u32 i = 0; i < nregs && cp.good(); i++) {
+            std::string name = cp.read_string();
+            std::string value = cp.read_string();
+            if (regs.count(name) == 0) {
+                log_warn("checkpoint register %s not found", name.c_str());
+                continue;
+            }
+
+            regs[name]->str(value);
+        }
+    }
+
+    void system::save_devices(checkpoint& cp) {
+        m_vblk.save_state(cp);
+        m_vnet.save_state(cp);
+        m_vcon.save_state(cp);
+
+        std::vector<vcml::u8> bds(OR1KMVP_ETHOC_BD_COUNT * 8);
+        vcml::u64 addr = OR1KMVP_ETHOC_ADDR + OR1KMVP_ETHOC_BD_ADDR;
+        if (!read_memory(addr, bds.data(), bds.size()))
+            VCML_ERROR("failed to read ethoc descriptors");
+        cp.write(bds.data(), bds.size());
+    }
+
+    void system::load_devices(checkpoint& cp) {
+        m_vblk.load_state(cp);
+        m_vnet.load_state(cp);
+        m_vcon.load_state(cp);
+
+        std::vector<vcml::u8> bds(OR1KMVP_ETHOC_BD_COUNT * 8);
+        vcml::u64 addr = OR1KMVP_ETHOC_ADDR + OR1KMVP_ETHOC_BD_ADDR;
+        cp.read(bds.data(), bds.size());
+        if (cp.good() && !write_memory(addr, bds.data(), bds.size()))
+            VCML_ERROR("failed to write ethoc descriptors");
+    }
+
+    bool system::save_checkpoint(const std::string& filename) {
+        std::string reason;
+        if (!can_checkpoint(reason)) {
+            log_error("cannot checkpoint: %s", reason.c_str());
+            return false;
+        }
+
+        std::fstream file(filename.c_str(), std::ios::out |
+                          std::ios::binary | std::ios::trunc);
+        if (!file.good()) {
+            log_error("cannot open checkpoint file %s", filename.c_str());
+            return false;
+        }
+
+        checkpoint cp(file);
+        cp.write(std::string(OR1KMVP_CHECKPOINT_MAGIC));
+        cp.write<vcml::u32>(OR1KMVP_CHECKPOINT_VERSION);
+        save_state(cp);
+
+        if (!cp.good()) {
+            log_error("error writing checkpoint file %s", filename.c_str());
+            return false;
+        }
+
+        log_info("saved checkpoint %s at %s", filename.c_str(),
+                 sc_core::sc_time_stamp().to_string().c_str());
+        return true;
+    }
+
+    bool system::load_checkpoint(const std::string& filename) {
+        std::fstream file(filename.c_str(), std::ios::in | std::ios::binary);
+        if (!file.good()) {
+            log_error("cannot open checkpoint file %s", filename.c_str());
+            return false;
+        }
+
+        checkpoint cp(file);
+        if (cp.read_string() != OR1KMVP_CHECKPOINT_MAGIC ||
+            cp.read<vcml::u32>() != OR1KMVP_CHECKPOINT_VERSION) {
+            log_error("invalid checkpoint file %s", filename.c_str());
+            return false;
+        }
+
+        load_state(cp);
+
+        if (!cp.good()) {
+            log_error("error reading checkpoint file %s", filename.c_str());
+            return false;
+        }
+
+        log_info("restored checkpoint %s", filename.c_str());
+        return true;
+    }
+
+    bool system::save_snapshot() {
+        for (auto cpu : m_cpus)
+            if (cpu->is_executing())
+                return false;
+
+        m_snapshot_state.str("");
+        m_snapshot_state.clear();
+
+        checkpoint cp(m_snapshot_state);
+        save_cpus(cp);
+        save_registers(cp);
+        save_devices(cp);
+
+        // Memory revokes all DMI pointers and hands them out again page by
+        // page, recording every page that can be written as dirty.
+        m_snapshot.activate();
+        m_mem.start_tracking();
+        for (auto cpu : m_cpus)
+            cpu->invalidate_data_dmi();
+
+        return cp.good();
+    }
+
+    bool system::restore_snapshot() {
+        if (!m_snapshot.is_active())
+            return false;
+
+        for (auto cpu : m_cpus)
+            if (cpu->is_executing())
+                return false;
+
+        for (auto cpu : m_cpus)
+            cpu->invalidate_data_dmi();
+
+        for (vcml::u64 page : m_snapshot.dirty_pages()) {
+            vcml::range addr = m_snapshot.page_range(page * OR1KISS_PAGE_SIZE);
+            addr.start += mem.get().start;
+            addr.end += mem.get().start;
+            for (auto cpu : m_cpus)
+                cpu->flush_decode_cache(addr);
+        }
+
+        if (!m_snapshot.restore())
+            return false;
+
+        // Restored pages are clean again, so their write grants must go
+        // and reservations may refer to values that no longer exist.
+        m_mem.start_tracking();
+        if (m_exmon != NULL)
+            m_exmon->cancel_reservations();
+
+        m_snapshot_state.clear();
+        m_snapshot_state.seekg(0);
+
+        checkpoint cp(m_snapshot_state);
+        load_cpus(cp);
+        load_registers(cp);
+        load_devices(cp);
+
+        return cp.good();
+    }
+
     system::system(const sc_core::sc_module_name& nm):
         vcml::system(nm),
         nrcpu("nrcpu", 1),
@@ -35,7 +605,51 @@ namespace or1kmvp {
         ompic("ompic", vcml::range(OR1KMVP_OMPIC_ADDR, OR1KMVP_OMPIC_END)),
         hwrng("hwrng", vcml::range(OR1KMVP_HWRNG_ADDR, OR1KMVP_HWRNG_END)),
         sdhci("sdhci", vcml::range(OR1KMVP_SDHCI_ADDR, OR1KMVP_SDHCI_END)),
+        vblk ("vblk",  vcml::range(OR1KMVP_VBLK_ADDR,  OR1KMVP_VBLK_END)),
+        vnet ("vnet",  vcml::range(OR1KMVP_VNET_ADDR,  OR1KMVP_VNET_END)),
+        vcon ("vcon",  vcml::range(OR1KMVP_VCON_ADDR,  OR1KMVP_VCON_END)),
+        checkpoint_file("checkpoint_file", ""),
+        checkpoint_time("checkpoint_time", sc_core::SC_ZERO_TIME),
+        restore_file("restore_file", ""),
+        trace_file("trace_file", ""),
+        trace_delta("trace_delta", true),
+        trace_regs("trace_regs", false),
+        bus_stats("bus_stats", false),
+        irq_latency_file("irq_latency_file", ""),
+        exclusive_monitor("exclusive_monitor", true),
+        exclusive_granule("exclusive_granule", 4),
+        telemetry_file("telemetry_file", ""),
+        telemetry_socket("telemetry_socket", ""),
+        telemetry_interval("telemetry_interval", 10.0),
+        adaptive_quantum("adaptive_quantum", false),
+        quantum_min("quantum_min", sc_core::sc_time(1.0, sc_core::SC_US)),
+        quantum_max("quantum_max", sc_core::sc_time(100.0, sc_core::SC_US)),
+        quantum_events("quantum_events", 16),
+        fastforward("fastforward", false),
+        fastforward_quantum("fastforward_quantum",
+                            sc_core::sc_time(10.0, sc_core::SC_MS)),
+        fastforward_symbol("fastforward_symbol", ""),
+        fastforward_nop("fastforward_nop", 0),
         m_cpus(nrcpu),
+        m_tracer(NULL),
+        m_telemetry(NULL),
+        m_exmon(NULL),
+        m_mmio_table(256),
+        m_address_map(),
+        m_monitors(),
+        m_snapshot(vcml::range(0, mem.get().length() - 1), OR1KISS_PAGE_SIZE,
+            [this](vcml::u64 addr, void* ptr, unsigned int sz) -> bool {
+                memcpy(ptr, m_mem.get_data_ptr() + addr, sz);
+                return true;
+            },
+            [this](vcml::u64 addr, const void* ptr, unsigned int sz) -> bool {
+                memcpy(m_mem.get_data_ptr() + addr, ptr, sz);
+                return true;
+            }),
+        m_snapshot_state(),
+        m_ff_done("ff_done"),
+        m_quantum_changes(0),
+        m_quantum_hist(),
         m_clock("clock", OR1KMVP_CPU_DEFCLK),
         m_reset("reset"),
         m_bus("bus"),
@@ -55,6 +669,9 @@ namespace or1kmvp {
         m_spi2sd("spi2sd"),
         m_sdcard0("sdcard0"),
         m_sdcard1("sdcard1"),
+        m_vblk("vblk"),
+        m_vnet("vnet"),
+        m_vcon("vcon"),
         m_sig_clock("sig_clock"),
         m_sig_reset("sig_reset"),
         m_gpio_spi0("gpio_spi0"),
@@ -65,6 +682,9 @@ namespace or1kmvp {
         m_irq_ockbd("irq_ockbd"),
         m_irq_ocspi("irq_ocspi"),
         m_irq_sdhci("irq_sdhci"),
+        m_irq_vblk("irq_vblk"),
+        m_irq_vnet("irq_vnet"),
+        m_irq_vcon("irq_vcon"),
         m_irq_ompic(nrcpu) {
 
         m_uart0.set_big_endian();
@@ -78,16 +698,72 @@ namespace or1kmvp {
         m_ompic.set_big_endian();
         m_hwrng.set_big_endian();
         m_sdhci.set_little_endian();
+        m_vblk.set_little_endian();
+        m_vnet.set_little_endian();
+        m_vcon.set_little_endian();
+        m_mem.set_snapshot(&m_snapshot);
 
         for (unsigned int cpu = 0; cpu < nrcpu; cpu++) {
             std::stringstream ss; ss << "cpu" << cpu;
             m_cpus[cpu] = new openrisc(ss.str().c_str(), cpu);
         }
 
+        for (openrisc* cpu : m_cpus)
+            cpu->set_peers(m_cpus);
+
+        if (exclusive_monitor) {
+            m_exmon = new exmon(exclusive_granule);
+            for (openrisc* cpu : m_cpus)
+                cpu->set_exmon(m_exmon);
+        }
+
+        if (fastforward) {
+            bool markers = false;
+            for (openrisc* cpu : m_cpus) {
+                markers |= cpu->start_fastforward(fastforward_symbol,
+                                                  fastforward_nop, [this]() {
+                    for (openrisc* other : m_cpus)
+                        other->stop_fastforward();
+                    m_ff_done.notify();
+                });
+            }
+
+            if (!markers)
+                log_warn("no fast-forward markers found, staying in "
+                         "fast-forward mode for the entire simulation");
+        }
+
+        if (!trace_file.get().empty()) {
+            m_tracer = new tracer(trace_file, trace_delta);
+            if (m_tracer->is_open()) {
+                for (openrisc* cpu : m_cpus)
+                    cpu->set_tracer(m_tracer, trace_regs);
+                m_tracer->start();
+            }
+        }
+
+        if (!telemetry_file.get().empty() || !telemetry_socket.get().empty())
+            m_telemetry = new telemetry(m_cpus, telemetry_file,
+                                        telemetry_socket, telemetry_interval);
+
         // Bus mapping
+        m_address_map = {
+            { "mem", mem }, { "uart0", uart0 }, { "uart1", uart1 },
+            { "rtc", rtc }, { "gpio", gpio }, { "hwrng", hwrng },
+            { "sdhci", sdhci }, { "ompic", ompic }, { "ethoc", ethoc },
+            { "ocfbc", ocfbc }, { "ockbd", ockbd }, { "ocspi", ocspi },
+            { "vblk", vblk }, { "vnet", vnet }, { "vcon", vcon },
+        };
+
         for (openrisc* cpu : m_cpus) {
-           m_bus.bind(cpu->INSN);
-           m_bus.bind(cpu->DATA);
+            bind_initiator(cpu->INSN, std::string(cpu->basename()) + ".INSN");
+            bind_initiator(cpu->DATA, std::string(cpu->basename()) + ".DATA");
+        }
+
+        if (m_mem.size != mem.get().length()) {
+            log_warn("size of memory (0x%" PRIx64 ") does not match its "
+                     "address range (0x%" PRIx64 ")", m_mem.size.get(),
+                     mem.get().length());
         }
 
         m_bus.bind(m_mem.IN, mem);
@@ -97,14 +773,20 @@ namespace or1kmvp {
         m_bus.bind(m_gpio.IN, gpio);
         m_bus.bind(m_hwrng.IN, hwrng);
         m_bus.bind(m_sdhci.IN, sdhci);
-        m_bus.bind(m_sdhci.OUT);
+        bind_initiator(m_sdhci.OUT, "sdhci.OUT");
         m_bus.bind(m_ompic.IN, ompic);
         m_bus.bind(m_ethoc.IN, ethoc);
-        m_bus.bind(m_ethoc.OUT);
+        bind_initiator(m_ethoc.OUT, "ethoc.OUT");
         m_bus.bind(m_ocfbc.IN, ocfbc);
-        m_bus.bind(m_ocfbc.OUT);
+        bind_initiator(m_ocfbc.OUT, "ocfbc.OUT");
         m_bus.bind(m_ockbd.IN, ockbd);
         m_bus.bind(m_ocspi.IN, ocspi);
+        m_bus.bind(m_vblk.IN, vblk);
+        bind_initiator(m_vblk.OUT, "vblk.OUT");
+        m_bus.bind(m_vnet.IN, vnet);
+        bind_initiator(m_vnet.OUT, "vnet.OUT");
+        m_bus.bind(m_vcon.IN, vcon);
+        bind_initiator(m_vcon.OUT, "vcon.OUT");
 
         // Clock
         m_clock.CLOCK.bind(m_sig_clock);
@@ -125,6 +807,9 @@ namespace or1kmvp {
         m_spi2sd.CLOCK.bind(m_sig_clock);
         m_sdcard0.CLOCK.bind(m_sig_clock);
         m_sdcard1.CLOCK.bind(m_sig_clock);
+        m_vblk.CLOCK.bind(m_sig_clock);
+        m_vnet.CLOCK.bind(m_sig_clock);
+        m_vcon.CLOCK.bind(m_sig_clock);
 
         for (auto cpu : m_cpus)
             cpu->CLOCK.bind(m_sig_clock);
@@ -148,6 +833,9 @@ namespace or1kmvp {
         m_spi2sd.RESET.bind(m_sig_reset);
         m_sdcard0.RESET.bind(m_sig_reset);
         m_sdcard1.RESET.bind(m_sig_reset);
+        m_vblk.RESET.bind(m_sig_reset);
+        m_vnet.RESET.bind(m_sig_reset);
+        m_vcon.RESET.bind(m_sig_reset);
 
         for (auto cpu : m_cpus)
             cpu->RESET.bind(m_sig_reset);
@@ -163,6 +851,9 @@ namespace or1kmvp {
         m_ockbd.IRQ.bind(m_irq_ockbd);
         m_ocspi.IRQ.bind(m_irq_ocspi);
         m_sdhci.IRQ.bind(m_irq_sdhci);
+        m_vblk.IRQ.bind(m_irq_vblk);
+        m_vnet.IRQ.bind(m_irq_vnet);
+        m_vcon.IRQ.bind(m_irq_vcon);
 
         for (auto cpu : m_cpus) {
             unsigned int irq_uart0 = cpu->irq_uart0;
@@ -173,6 +864,9 @@ namespace or1kmvp {
             unsigned int irq_ocspi = cpu->irq_ocspi;
             unsigned int irq_ompic = cpu->irq_ompic;
             unsigned int irq_sdhci = cpu->irq_sdhci;
+            unsigned int irq_vblk = cpu->irq_vblk;
+            unsigned int irq_vnet = cpu->irq_vnet;
+            unsigned int irq_vcon = cpu->irq_vcon;
 
             cpu->IRQ[irq_uart0].bind(m_irq_uart0);
             cpu->IRQ[irq_uart1].bind(m_irq_uart1);
@@ -181,6 +875,9 @@ namespace or1kmvp {
             cpu->IRQ[irq_ockbd].bind(m_irq_ockbd);
             cpu->IRQ[irq_ocspi].bind(m_irq_ocspi);
             cpu->IRQ[irq_sdhci].bind(m_irq_sdhci);
+            cpu->IRQ[irq_vblk].bind(m_irq_vblk);
+            cpu->IRQ[irq_vnet].bind(m_irq_vnet);
+            cpu->IRQ[irq_vcon].bind(m_irq_vcon);
 
             vcml::u64 id = cpu->core_id();
             std::stringstream ss; ss << "irq_ompic_cpu" << id;
@@ -196,6 +893,21 @@ namespace or1kmvp {
         // sdcard0 -> SDHCI, sdcard1 -> SPI
         m_sdhci.SD_OUT.bind(m_sdcard0.SD_IN);
         m_spi2sd.SD_OUT.bind(m_sdcard1.SD_IN);
+
+        register_command("checkpoint", 1, this, &system::cmd_checkpoint,
+                         "writes the platform state to checkpoint <file>");
+
+        register_command("snapshot", 0, this, &system::cmd_snapshot,
+                         "records an in-memory snapshot of the platform");
+        register_command("rewind", 0, this, &system::cmd_rewind,
+                         "restores the platform to the last snapshot");
+        register_command("busstats", 0, this, &system::cmd_busstats,
+                         "prints bus access statistics per initiator and "
+                         "target, use 'busstats clear' to reset them");
+
+        SC_HAS_PROCESS(system);
+        SC_THREAD(checkpoint_thread);
+        SC_THREAD(quantum_thread);
     }
 
     system::~system() {
@@ -203,12 +915,23 @@ namespace or1kmvp {
             SAFE_DELETE(irq);
         for (auto cpu : m_cpus)
             SAFE_DELETE(cpu);
+        for (auto mon : m_monitors)
+            SAFE_DELETE(mon.second);
+        SAFE_DELETE(m_tracer);
+        SAFE_DELETE(m_telemetry);
+        SAFE_DELETE(m_exmon);
     }
 
     int system::run() {
+        if (m_telemetry != NULL)
+            m_telemetry->start();
+
         double simstart = vcml::realtime();
         int result = vcml::system::run();
         double realtime = vcml::realtime() - simstart;
+
+        if (m_telemetry != NULL)
+            m_telemetry->stop();
         double duration = sc_core::sc_time_stamp().to_seconds();
 
         log_info("duration           %.9fs", duration);
@@ -222,16 +945,101 @@ namespace or1kmvp {
         log_info("sim speed          %.1f MIPS", realtime == 0.0 ? 0.0 :
                                                  ninsn / realtime / 1e6);
 
+        log_quantum_info();
+
+        if (m_tracer != NULL && m_tracer->is_open()) {
+            m_tracer->close();
+            log_info("trace records      %" PRId64 " (%.2f bytes each)",
+                     m_tracer->num_records(), m_tracer->num_records() == 0 ?
+                     0.0 : (double)m_tracer->num_bytes() /
+                     m_tracer->num_records());
+            log_info("trace stalls       %" PRId64, m_tracer->num_stalls());
+        }
+
+        vcml::u64 touched = m_mem.touched_pages() * m_mem.page_size();
+        log_info("memory touched     %.1fMB of %.1fMB (%.1f%%)",
+                 touched / 1048576.0, m_mem.size / 1048576.0,
+                 touched * 100.0 / m_mem.size);
+
+        if (!m_monitors.empty()) {
+            std::stringstream ss;
+            report_bus_stats(ss);
+            std::string line;
+            while (std::getline(ss, line))
+                log_info("%s", line.c_str());
+        }
+
+        if (m_snapshot.num_restores() > 0) {
+            log_info("snapshot restores  %" PRId64, m_snapshot.num_restores());
+            log_info("avg pages restored %.1f",
+                     (double)m_snapshot.num_pages_restored() /
+                     m_snapshot.num_restores());
+        }
+
+        log_hot_locks();
+
         for (auto cpu : m_cpus)
             cpu->log_timing_info();
 
+        if (!irq_latency_file.get().empty())
+            write_irq_latency(irq_latency_file);
+
+        // a semihosting exit call determines the simulator exit code
+        for (auto cpu : m_cpus) {
+            int status;
+            if (cpu->exit_status(status))
+                result = status;
+        }
+
         return result;
     }
 
+    void system::map_mmio(vcml::slave_socket& socket,
+                          const vcml::range& addr) {
+        // Only windows that lie within a single 16MB region can be looked up
+        // by the top address byte, everything else goes through the bus.
+        if ((addr.start >> 24) != (addr.end >> 24) || addr.overlaps(mem))
+            return;
+
+        mmio_target& entry = m_mmio_table[addr.start >> 24];
+        if (entry.shared)
+            return;
+
+        if (entry.target != NULL) {
+            entry.target = NULL; // shared region, needs bus decoding
+            entry.shared = true;
+            return;
+        }
+
+        entry.addr = addr;
+        entry.target = socket.get_base_export().get_interface();
+    }
+
     void system::end_of_elaboration() {
         std::stringstream ss;
         m_bus.execute("show", VCML_NO_ARGS, ss);
         vcml::log_debug("%s", ss.str().c_str());
+
+        map_mmio(m_uart0.IN, uart0);
+        map_mmio(m_uart1.IN, uart1);
+        map_mmio(m_rtc.IN, rtc);
+        map_mmio(m_gpio.IN, gpio);
+        map_mmio(m_hwrng.IN, hwrng);
+        map_mmio(m_sdhci.IN, sdhci);
+        map_mmio(m_ompic.IN, ompic);
+        map_mmio(m_ethoc.IN, ethoc);
+        map_mmio(m_ocfbc.IN, ocfbc);
+        map_mmio(m_ockbd.IN, ockbd);
+        map_mmio(m_ocspi.IN, ocspi);
+        map_mmio(m_vblk.IN, vblk);
+        map_mmio(m_vnet.IN, vnet);
+        map_mmio(m_vcon.IN, vcon);
+
+        // Direct dispatch would bypass the bus monitors
+        if (!bus_stats) {
+            for (openrisc* cpu : m_cpus)
+                cpu->set_mmio_table(&m_mmio_table);
+        }
     }
 
 }
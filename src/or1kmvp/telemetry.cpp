@@ -0,0 +1,240 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "or1kmvp/telemetry.h"
+
+namespace or1kmvp {
+
+    static void write_metric(std::ostream& os, const char* name,
+                             const char* type, const char* help) {
+        os << "# HELP or1kmvp_" << name << " " << help << std::endl
+           << "# TYPE or1kmvp_" << name << " " << type << std::endl;
+    }
+
+    void telemetry::reporter_thread() {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        double next = m_start + m_interval;
+        while (!m_exit) {
+            double now = vcml::realtime();
+            if (now >= next) {
+                sample();
+                write_file();
+                next = now + m_interval;
+                continue;
+            }
+
+            if (m_server < 0) {
+                m_cv.wait_for(lock, std::chrono::duration<double>(next - now));
+                continue;
+            }
+
+            // poll the socket in short intervals, so that stop() does not
+            // have to wait for a full sampling period
+            lock.unlock();
+            serve(std::min(next - now, 0.1));
+            lock.lock();
+        }
+    }
+
+    void telemetry::sample() {
+        double now = vcml::realtime();
+        double elapsed = now - m_start;
+        double period = now - m_last;
+
+        std::vector<vcml::u64> insns(m_cpus.size());
+        for (size_t i = 0; i < m_cpus.size(); i++)
+            insns[i] = m_cpus[i]->published_insns();
+
+        std::stringstream ss;
+        write_metric(ss, "instructions_total", "counter",
+                     "Instructions executed");
+        for (size_t i = 0; i < m_cpus.size(); i++)
+            ss << "or1kmvp_instructions_total{cpu=\""
+               << m_cpus[i]->basename() << "\"} " << insns[i] << std::endl;
+
+        write_metric(ss, "cycles_total", "counter", "Cycles simulated");
+        for (openrisc* cpu : m_cpus)
+            ss << "or1kmvp_cycles_total{cpu=\"" << cpu->basename() << "\"} "
+               << cpu->published_cycles() << std::endl;
+
+        write_metric(ss, "sleep_cycles_total", "counter",
+                     "Cycles spent sleeping");
+        for (openrisc* cpu : m_cpus)
+            ss << "or1kmvp_sleep_cycles_total{cpu=\"" << cpu->basename()
+               << "\"} " << cpu->published_sleep() << std::endl;
+
+        write_metric(ss, "decode_cache_hit_rate", "gauge",
+                     "Decode cache hit rate");
+        for (openrisc* cpu : m_cpus)
+            ss << "or1kmvp_decode_cache_hit_rate{cpu=\"" << cpu->basename()
+               << "\"} " << cpu->published_hit_rate() << std::endl;
+
+        write_metric(ss, "mips", "gauge",
+                     "Million instructions per host second since last sample");
+        for (size_t i = 0; i < m_cpus.size(); i++) {
+            double mips = period <= 0.0 ? 0.0 :
+                          (insns[i] - m_last_insns[i]) / period / 1e6;
+            ss << "or1kmvp_mips{cpu=\"" << m_cpus[i]->basename() << "\"} "
+               << mips << std::endl;
+        }
+
+        write_metric(ss, "sim_time_seconds", "gauge", "Simulated time");
+        for (openrisc* cpu : m_cpus)
+            ss << "or1kmvp_sim_time_seconds{cpu=\"" << cpu->basename()
+               << "\"} " << cpu->published_time() << std::endl;
+
+        write_metric(ss, "real_time_ratio", "gauge",
+                     "Host seconds needed per simulated second");
+        for (openrisc* cpu : m_cpus) {
+            double sim = cpu->published_time();
+            ss << "or1kmvp_real_time_ratio{cpu=\"" << cpu->basename()
+               << "\"} " << (sim == 0.0 ? 0.0 : elapsed / sim) << std::endl;
+        }
+
+        write_metric(ss, "host_time_seconds", "gauge",
+                     "Host time since simulation start");
+        ss << "or1kmvp_host_time_seconds " << elapsed << std::endl;
+
+        m_report = ss.str();
+        m_last_insns = insns;
+        m_last = now;
+    }
+
+    void telemetry::write_file() {
+        if (m_file.empty())
+            return;
+
+        // write to a temporary file and rename it over the report, so that
+        // readers never observe a partially written sample
+        std::string tmp = m_file + ".tmp";
+        std::ofstream os(tmp.c_str());
+        if (!os.good())
+            return;
+
+        os << m_report;
+        os.close();
+
+        ::rename(tmp.c_str(), m_file.c_str());
+    }
+
+    void telemetry::serve(double timeout) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(m_server, &fds);
+
+        struct timeval tv;
+        tv.tv_sec = (time_t)timeout;
+        tv.tv_usec = (suseconds_t)((timeout - tv.tv_sec) * 1e6);
+
+        if (::select(m_server + 1, &fds, NULL, NULL, &tv) <= 0)
+            return;
+
+        int fd = ::accept(m_server, NULL, NULL);
+        if (fd < 0)
+            return;
+
+        const char* data = m_report.c_str();
+        size_t size = m_report.size();
+        while (size > 0) {
+            ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+            if (n <= 0)
+                break;
+            data += n;
+            size -= n;
+        }
+
+        ::close(fd);
+    }
+
+    telemetry::telemetry(const std::vector<openrisc*>& cpus,
+                         const std::string& file, const std::string& socket,
+                         double interval):
+        m_cpus(cpus),
+        m_file(file),
+        m_socket(socket),
+        m_interval(interval > 0.0 ? interval : 1.0),
+        m_server(-1),
+        m_thread(),
+        m_mtx(),
+        m_cv(),
+        m_exit(false),
+        m_start(0.0),
+        m_last(0.0),
+        m_last_insns(cpus.size(), 0),
+        m_report() {
+        if (m_socket.empty())
+            return;
+
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (m_socket.length() >= sizeof(addr.sun_path)) {
+            vcml::log_warn("telemetry socket path too long: %s",
+                           m_socket.c_str());
+            return;
+        }
+
+        strncpy(addr.sun_path, m_socket.c_str(), sizeof(addr.sun_path) - 1);
+        ::unlink(m_socket.c_str());
+
+        m_server = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (m_server < 0 ||
+            ::bind(m_server, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+            ::listen(m_server, 4) < 0) {
+            vcml::log_warn("cannot open telemetry socket %s: %s",
+                           m_socket.c_str(), strerror(errno));
+            if (m_server >= 0)
+                ::close(m_server);
+            m_server = -1;
+        }
+    }
+
+    telemetry::~telemetry() {
+        stop();
+
+        if (m_server >= 0) {
+            ::close(m_server);
+            ::unlink(m_socket.c_str());
+        }
+    }
+
+    void telemetry::start() {
+        if (m_thread.joinable())
+            return;
+
+        m_start = m_last = vcml::realtime();
+        m_thread = std::thread(&telemetry::reporter_thread, this);
+    }
+
+    void telemetry::stop() {
+        if (!m_thread.joinable())
+            return;
+
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_exit = true;
+        m_cv.notify_all();
+        lock.unlock();
+
+        m_thread.join();
+
+        // leave a final sample behind for whoever picks up the results
+        sample();
+        write_file();
+    }
+
+}
@@ -0,0 +1,203 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "or1kmvp/tracer.h"
+
+#define OR1KMVP_TRACE_RING_SIZE (1 << 16)
+#define OR1KMVP_TRACE_BATCH     (4096)
+
+namespace or1kmvp {
+
+    tracer::ring::ring(size_t capacity):
+        m_buffer(capacity),
+        m_head(0),
+        m_tail(0) {
+        /* nothing to do */
+    }
+
+    bool tracer::ring::push(const trace_entry& entry) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t next = (head + 1) % m_buffer.size();
+        if (next == m_tail.load(std::memory_order_acquire))
+            return false;
+
+        m_buffer[head] = entry;
+        m_head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    size_t tracer::ring::pop(trace_entry* entries, size_t max) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t head = m_head.load(std::memory_order_acquire);
+
+        size_t n = 0;
+        while (tail != head && n < max) {
+            entries[n++] = m_buffer[tail];
+            tail = (tail + 1) % m_buffer.size();
+        }
+
+        m_tail.store(tail, std::memory_order_release);
+        return n;
+    }
+
+    void tracer::writer_thread() {
+        while (!m_exit) {
+            if (drain())
+                continue;
+
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_cv.wait_for(lock, std::chrono::milliseconds(1));
+        }
+
+        while (drain())
+            ; // flush remaining records
+    }
+
+    bool tracer::drain() {
+        bool work = false;
+        for (ring* r : m_rings) {
+            size_t n = r->pop(m_batch.data(), m_batch.size());
+            for (size_t i = 0; i < n; i++)
+                encode(m_batch[i]);
+            work |= n > 0;
+        }
+
+        return work;
+    }
+
+    void tracer::encode(const trace_entry& entry) {
+        vcml::u8 buf[32];
+        size_t n = 0;
+
+        if (!m_delta) {
+            buf[n++] = entry.core;
+            buf[n++] = entry.reg;
+            for (int i = 0; i < 8; i++)
+                buf[n++] = entry.cycle >> (i * 8);
+            for (int i = 0; i < 4; i++)
+                buf[n++] = entry.pc >> (i * 8);
+            for (int i = 0; i < 4; i++)
+                buf[n++] = entry.count >> (i * 8);
+            for (int i = 0; i < 4; i++)
+                buf[n++] = entry.value >> (i * 8);
+        } else if (entry.reg != OR1KMVP_TRACE_NOREG) {
+            buf[n++] = entry.core | OR1KMVP_TRACE_TAG_REG;
+            buf[n++] = entry.reg;
+            n += trace_put_varint(buf + n, entry.value);
+        } else {
+            unsigned int core = entry.core;
+            bool seq = entry.pc == m_last_pc[core];
+
+            buf[n++] = core | (seq ? OR1KMVP_TRACE_TAG_SEQ : 0);
+            n += trace_put_varint(buf + n, entry.cycle - m_last_cycle[core]);
+            if (!seq) {
+                vcml::i64 delta = (vcml::i64)entry.pc - m_last_pc[core];
+                n += trace_put_varint(buf + n, trace_zigzag(delta));
+            }
+
+            n += trace_put_varint(buf + n, entry.count);
+
+            // blocks are sequential if they start where the last one ended
+            m_last_cycle[core] = entry.cycle;
+            m_last_pc[core] = entry.pc + 4 * entry.count;
+        }
+
+        fwrite(buf, 1, n, m_file);
+        m_num_records++;
+        m_num_bytes += n;
+    }
+
+    tracer::tracer(const std::string& filename, bool delta):
+        m_file(NULL),
+        m_delta(delta),
+        m_rings(),
+        m_batch(OR1KMVP_TRACE_BATCH),
+        m_writer(),
+        m_mtx(),
+        m_cv(),
+        m_exit(false),
+        m_num_records(0),
+        m_num_bytes(0),
+        m_num_stalls(0),
+        m_last_cycle(),
+        m_last_pc() {
+        m_file = fopen(filename.c_str(), "wb");
+        if (m_file == NULL) {
+            vcml::log_warn("cannot open trace file '%s'", filename.c_str());
+            return;
+        }
+
+        vcml::u8 header[16] = { 0 };
+        memcpy(header, OR1KMVP_TRACE_MAGIC, 8);
+        vcml::u32 version = OR1KMVP_TRACE_VERSION;
+        vcml::u32 flags = delta ? OR1KMVP_TRACE_DELTA : 0;
+        for (int i = 0; i < 4; i++) {
+            header[8 + i] = version >> (i * 8);
+            header[12 + i] = flags >> (i * 8);
+        }
+
+        fwrite(header, 1, sizeof(header), m_file);
+        m_num_bytes = sizeof(header);
+    }
+
+    tracer::~tracer() {
+        close();
+        for (ring* r : m_rings)
+            delete r;
+    }
+
+    tracer::ring* tracer::attach(unsigned int core) {
+        VCML_ERROR_ON(core >= OR1KMVP_TRACE_MAXCORE, "too many cores");
+        VCML_ERROR_ON(m_writer.joinable(), "tracer already running");
+
+        ring* r = new ring(OR1KMVP_TRACE_RING_SIZE);
+        m_rings.push_back(r);
+        return r;
+    }
+
+    void tracer::start() {
+        if (m_file != NULL && !m_writer.joinable())
+            m_writer = std::thread(&tracer::writer_thread, this);
+    }
+
+    void tracer::record(ring* r, const trace_entry& entry) {
+        // Traces must be complete, so wait for the writer if it falls behind
+        // instead of dropping records.
+        while (!r->push(entry)) {
+            m_num_stalls++;
+            m_cv.notify_one();
+            std::this_thread::yield();
+        }
+    }
+
+    void tracer::close() {
+        if (m_file == NULL)
+            return;
+
+        m_exit = true;
+        m_cv.notify_one();
+        if (m_writer.joinable())
+            m_writer.join();
+        else
+            drain();
+
+        fclose(m_file);
+        m_file = NULL;
+    }
+
+}
@@ -0,0 +1,597 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "or1kmvp/virtio.h"
+
+#define OR1KMVP_VIRTIO_MAGIC    (0x74726976) // "virt"
+#define OR1KMVP_VIRTIO_VERSION  (2)
+#define OR1KMVP_VIRTIO_VENDOR   (0x4b31524f) // "OR1K"
+
+#define OR1KMVP_VIRTIO_CONFIG   (0x100)
+
+#define OR1KMVP_VIRTQ_DESC_NEXT     (1)
+#define OR1KMVP_VIRTQ_DESC_WRITE    (2)
+#define OR1KMVP_VIRTQ_DESC_INDIRECT (4)
+#define OR1KMVP_VIRTQ_AVAIL_NO_IRQ  (1)
+#define OR1KMVP_VIRTQ_MAX_INDIRECT  (1024)
+
+#define OR1KMVP_VIRTIO_IRQ_USED     (1)
+#define OR1KMVP_VIRTIO_IRQ_CONFIG   (2)
+
+#define OR1KMVP_VIRTIO_STATUS_OK    (4) // DRIVER_OK
+
+namespace or1kmvp {
+
+    enum virtio_reg {
+        VIRTIO_MAGIC = 0x000,
+        VIRTIO_VERSION = 0x004,
+        VIRTIO_DEVICE_ID = 0x008,
+        VIRTIO_VENDOR_ID = 0x00c,
+        VIRTIO_DEVICE_FEATURES = 0x010,
+        VIRTIO_DEVICE_FEATURES_SEL = 0x014,
+        VIRTIO_DRIVER_FEATURES = 0x020,
+        VIRTIO_DRIVER_FEATURES_SEL = 0x024,
+        VIRTIO_QUEUE_SEL = 0x030,
+        VIRTIO_QUEUE_NUM_MAX = 0x034,
+        VIRTIO_QUEUE_NUM = 0x038,
+        VIRTIO_QUEUE_READY = 0x044,
+        VIRTIO_QUEUE_NOTIFY = 0x050,
+        VIRTIO_IRQ_STATUS = 0x060,
+        VIRTIO_IRQ_ACK = 0x064,
+        VIRTIO_STATUS = 0x070,
+        VIRTIO_QUEUE_DESC_LO = 0x080,
+        VIRTIO_QUEUE_DESC_HI = 0x084,
+        VIRTIO_QUEUE_DRIVER_LO = 0x090,
+        VIRTIO_QUEUE_DRIVER_HI = 0x094,
+        VIRTIO_QUEUE_DEVICE_LO = 0x0a0,
+        VIRTIO_QUEUE_DEVICE_HI = 0x0a4,
+        VIRTIO_CONFIG_GEN = 0x0fc,
+    };
+
+    static void set_lo(vcml::u64& val, vcml::u32 lo) {
+        val = (val & 0xffffffff00000000ull) | lo;
+    }
+
+    static void set_hi(vcml::u64& val, vcml::u32 hi) {
+        val = (val & 0xffffffffull) | (vcml::u64)hi << 32;
+    }
+
+    size_t virtio_mmio::request::out_size() const {
+        size_t size = 0;
+        for (const buffer& buf : out)
+            size += buf.size;
+        return size;
+    }
+
+    size_t virtio_mmio::request::in_size() const {
+        size_t size = 0;
+        for (const buffer& buf : in)
+            size += buf.size;
+        return size;
+    }
+
+    vcml::u32 virtio_mmio::read_reg(vcml::u64 offset) {
+        virtqueue* vq = m_queue_sel < m_queues.size() ?
+                        &m_queues[m_queue_sel] : NULL;
+
+        switch (offset) {
+        case VIRTIO_MAGIC: return OR1KMVP_VIRTIO_MAGIC;
+        case VIRTIO_VERSION: return OR1KMVP_VIRTIO_VERSION;
+        case VIRTIO_DEVICE_ID: return m_device_id;
+        case VIRTIO_VENDOR_ID: return OR1KMVP_VIRTIO_VENDOR;
+        case VIRTIO_DEVICE_FEATURES:
+            if (m_features_sel > 1)
+                return 0;
+            return m_features >> (32 * m_features_sel);
+        case VIRTIO_QUEUE_NUM_MAX: return vq ? m_queue_max : 0;
+        case VIRTIO_QUEUE_NUM: return vq ? vq->size : 0;
+        case VIRTIO_QUEUE_READY: return vq ? vq->ready : 0;
+        case VIRTIO_IRQ_STATUS: return m_irq_status;
+        case VIRTIO_STATUS: return m_status;
+        case VIRTIO_QUEUE_DESC_LO: return vq ? vq->desc : 0;
+        case VIRTIO_QUEUE_DESC_HI: return vq ? vq->desc >> 32 : 0;
+        case VIRTIO_QUEUE_DRIVER_LO: return vq ? vq->driver : 0;
+        case VIRTIO_QUEUE_DRIVER_HI: return vq ? vq->driver >> 32 : 0;
+        case VIRTIO_QUEUE_DEVICE_LO: return vq ? vq->device : 0;
+        case VIRTIO_QUEUE_DEVICE_HI: return vq ? vq->device >> 32 : 0;
+        case VIRTIO_CONFIG_GEN: return m_config_gen;
+        default:
+            return 0;
+        }
+    }
+
+    void virtio_mmio::write_reg(vcml::u64 offset, vcml::u32 val) {
+        virtqueue* vq = m_queue_sel < m_queues.size() ?
+                        &m_queues[m_queue_sel] : NULL;
+
+        switch (offset) {
+        case VIRTIO_DEVICE_FEATURES_SEL:
+            m_features_sel = val;
+            break;
+
+        case VIRTIO_DRIVER_FEATURES:
+            if (m_driver_features_sel == 0)
+                set_lo(m_driver_features, val & m_features);
+            else if (m_driver_features_sel == 1)
+                set_hi(m_driver_features, val & (m_features >> 32));
+            break;
+
+        case VIRTIO_DRIVER_FEATURES_SEL:
+            m_driver_features_sel = val;
+            break;
+
+        case VIRTIO_QUEUE_SEL:
+            m_queue_sel = val;
+            break;
+
+        case VIRTIO_QUEUE_NUM:
+            if (vq && val <= m_queue_max)
+                vq->size = val;
+            break;
+
+        case VIRTIO_QUEUE_READY:
+            if (vq) {
+                vq->ready = val & 1;
+                vq->last_avail = 0;
+                vq->used = 0;
+            }
+            break;
+
+        case VIRTIO_QUEUE_NOTIFY:
+            m_num_notifies++;
+            if (val < m_queues.size() && is_queue_ready(val))
+                handle_queue(val);
+            break;
+
+        case VIRTIO_IRQ_ACK:
+            m_irq_status &= ~val;
+            update_irq();
+            break;
+
+        case VIRTIO_STATUS:
+            m_status = val;
+            if (val == 0) {
+                reset_transport();
+                update_irq();
+                device_reset();
+            }
+            break;
+
+        case VIRTIO_QUEUE_DESC_LO: if (vq) set_lo(vq->desc, val); break;
+        case VIRTIO_QUEUE_DESC_HI: if (vq) set_hi(vq->desc, val); break;
+        case VIRTIO_QUEUE_DRIVER_LO: if (vq) set_lo(vq->driver, val); break;
+        case VIRTIO_QUEUE_DRIVER_HI: if (vq) set_hi(vq->driver, val); break;
+        case VIRTIO_QUEUE_DEVICE_LO: if (vq) set_lo(vq->device, val); break;
+        case VIRTIO_QUEUE_DEVICE_HI: if (vq) set_hi(vq->device, val); break;
+
+        default:
+            break;
+        }
+    }
+
+    void virtio_mmio::update_irq() {
+        IRQ = m_irq_status != 0;
+    }
+
+    vcml::u16 virtio_mmio::read16(vcml::u64 addr) {
+        vcml::u8 buf[2] = { 0 };
+        dma_read(addr, buf, sizeof(buf));
+        return virtio_le16(buf);
+    }
+
+    vcml::u32 virtio_mmio::read32(vcml::u64 addr) {
+        vcml::u8 buf[4] = { 0 };
+        dma_read(addr, buf, sizeof(buf));
+        return virtio_le32(buf);
+    }
+
+    vcml::u64 virtio_mmio::read64(vcml::u64 addr) {
+        vcml::u8 buf[8] = { 0 };
+        dma_read(addr, buf, sizeof(buf));
+        return virtio_le64(buf);
+    }
+
+    void virtio_mmio::write16(vcml::u64 addr, vcml::u16 val) {
+        vcml::u8 buf[2];
+        virtio_put_le(buf, val, sizeof(buf));
+        dma_write(addr, buf, sizeof(buf));
+    }
+
+    void virtio_mmio::write32(vcml::u64 addr, vcml::u32 val) {
+        vcml::u8 buf[4];
+        virtio_put_le(buf, val, sizeof(buf));
+        dma_write(addr, buf, sizeof(buf));
+    }
+
+    vcml::u8* virtio_mmio::dma_ptr(vcml::u64 addr, vcml::u32 size,
+                                   bool write) {
+        tlm::tlm_dmi dmi;
+        tlm::tlm_command cmd = write ? tlm::TLM_WRITE_COMMAND
+                                     : tlm::TLM_READ_COMMAND;
+        if (size == 0 || !OUT.dmi().lookup(addr, addr + size - 1, cmd, dmi))
+            return NULL;
+
+        return dmi.get_dmi_ptr() + (addr - dmi.get_start_address());
+    }
+
+    bool virtio_mmio::dma_read(vcml::u64 addr, void* data, vcml::u32 size) {
+        vcml::u8* ptr = dma_ptr(addr, size, false);
+        if (ptr != NULL) {
+            memcpy(data, ptr, size);
+            return true;
+        }
+
+        tlm::tlm_response_status rs = OUT.read(addr, data, size);
+        if (rs != tlm::TLM_OK_RESPONSE) {
+            log_warn("dma read from 0x%08" PRIx64 " failed", addr);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool virtio_mmio::dma_write(vcml::u64 addr, const void* data,
+                                vcml::u32 size) {
+        vcml::u8* ptr = dma_ptr(addr, size, true);
+        if (ptr != NULL) {
+            memcpy(ptr, data, size);
+            return true;
+        }
+
+        tlm::tlm_response_status rs = OUT.write(addr, data, size);
+        if (rs != tlm::TLM_OK_RESPONSE) {
+            log_warn("dma write to 0x%08" PRIx64 " failed", addr);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool virtio_mmio::get_request(unsigned int queue, request& req) {
+        if (!is_queue_ready(queue))
+            return false;
+
+        virtqueue& vq = m_queues[queue];
+        vcml::u16 avail = read16(vq.driver + 2);
+        if (avail == vq.last_avail)
+            return false;
+
+        // the ring contents must not be read before the index
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        vcml::u64 slot = vq.driver + 4 + 2 * (vq.last_avail % vq.size);
+        req.head = read16(slot);
+        req.out.clear();
+        req.in.clear();
+        req.length = 0;
+        vq.last_avail++;
+
+        vcml::u64 table = vq.desc;
+        vcml::u32 count = vq.size;
+        vcml::u32 limit = vq.size;
+        vcml::u32 idx = req.head;
+        bool indirect = false;
+
+        // A valid chain visits each descriptor of a table at most once, so
+        // at most vq.size descriptors plus one indirect table are read and
+        // broken or looping chains cannot keep us here forever.
+        for (vcml::u32 n = 0; n < limit && idx < count; n++) {
+            vcml::u8 desc[16];
+            if (!dma_read(table + 16 * idx, desc, sizeof(desc)))
+                break;
+
+            buffer buf;
+            buf.addr = virtio_le64(desc + 0);
+            buf.size = virtio_le32(desc + 8);
+            vcml::u16 flags = virtio_le16(desc + 12);
+            vcml::u16 next = virtio_le16(desc + 14);
+
+            if (flags & OR1KMVP_VIRTQ_DESC_INDIRECT) {
+                if (indirect) {
+                    log_warn("nested indirect descriptor in queue %u",
+                             queue);
+                    break;
+                }
+
+                indirect = true;
+                table = buf.addr;
+                count = std::min<vcml::u32>(buf.size / sizeof(desc),
+                                            OR1KMVP_VIRTQ_MAX_INDIRECT);
+                limit = n + 1 + count;
+                idx = 0;
+                continue;
+            }
+
+            if (flags & OR1KMVP_VIRTQ_DESC_WRITE)
+                req.in.push_back(buf);
+            else
+                req.out.push_back(buf);
+
+            if (!(flags & OR1KMVP_VIRTQ_DESC_NEXT))
+                break;
+
+            idx = next;
+        }
+
+        m_num_requests++;
+        return true;
+    }
+
+    void virtio_mmio::unget_request(unsigned int queue) {
+        if (!is_queue_ready(queue))
+            return;
+
+        m_queues[queue].last_avail--;
+        m_num_requests--;
+    }
+
+    void virtio_mmio::put_request(unsigned int queue, const request& req) {
+        if (!is_queue_ready(queue))
+            return;
+
+        virtqueue& vq = m_queues[queue];
+        vcml::u64 elem = vq.device + 4 + 8 * (vq.used % vq.size);
+        write32(elem + 0, req.head);
+        write32(elem + 4, req.length);
+
+        // the driver must see the element before the updated index
+        std::atomic_thread_fence(std::memory_order_release);
+        write16(vq.device + 2, ++vq.used);
+    }
+
+    void virtio_mmio::put_requests(unsigned int queue,
+                                   const std::vector<request>& reqs) {
+        if (!is_queue_ready(queue) || reqs.empty())
+            return;
+
+        virtqueue& vq = m_queues[queue];
+        vcml::u16 used = vq.used;
+        for (const request& req : reqs) {
+            vcml::u64 elem = vq.device + 4 + 8 * (used++ % vq.size);
+            write32(elem + 0, req.head);
+            write32(elem + 4, req.length);
+        }
+
+        // all elements become visible to the driver at once
+        std::atomic_thread_fence(std::memory_order_release);
+        write16(vq.device + 2, vq.used = used);
+    }
+
+    bool virtio_mmio::is_queue_ready(unsigned int queue) const {
+        return queue < m_queues.size() && m_queues[queue].ready &&
+               m_queues[queue].size > 0;
+    }
+
+    size_t virtio_mmio::copy_out(const request& req, size_t offset,
+                                 void* data, size_t size) {
+        size_t done = 0;
+        for (const buffer& buf : req.out) {
+            if (done == size)
+                break;
+
+            if (offset >= buf.size) {
+                offset -= buf.size;
+                continue;
+            }
+
+            size_t n = std::min(buf.size - offset, size - done);
+            if (!dma_read(buf.addr + offset, (vcml::u8*)data + done, n))
+                break;
+
+            done += n;
+            offset = 0;
+        }
+
+        return done;
+    }
+
+    size_t virtio_mmio::copy_in(const request& req, size_t offset,
+                                const void* data, size_t size) {
+        size_t done = 0;
+        for (const buffer& buf : req.in) {
+            if (done == size)
+                break;
+
+            if (offset >= buf.size) {
+                offset -= buf.size;
+                continue;
+            }
+
+            size_t n = std::min(buf.size - offset, size - done);
+            if (!dma_write(buf.addr + offset, (const vcml::u8*)data + done,
+                           n))
+                break;
+
+            done += n;
+            offset = 0;
+        }
+
+        return done;
+    }
+
+    void virtio_mmio::notify_used(unsigned int queue) {
+        // The driver may ask not to be interrupted, e.g. while it polls the
+        // used ring. It checks the ring again after re-enabling interrupts,
+        // so the used index must be visible before the flags are read.
+        const virtqueue& vq = m_queues[queue];
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (read16(vq.driver) & OR1KMVP_VIRTQ_AVAIL_NO_IRQ)
+            return;
+
+        m_irq_status |= OR1KMVP_VIRTIO_IRQ_USED;
+        update_irq();
+    }
+
+    void virtio_mmio::notify_config() {
+        m_config_gen++;
+        m_irq_status |= OR1KMVP_VIRTIO_IRQ_CONFIG;
+        update_irq();
+    }
+
+    bool virtio_mmio::is_driver_ok() const {
+        return m_status & OR1KMVP_VIRTIO_STATUS_OK;
+    }
+
+    bool virtio_mmio::has_feature(unsigned int bit) const {
+        return (m_driver_features >> bit) & 1;
+    }
+
+    void virtio_mmio::set_features(vcml::u64 features) {
+        m_features = features;
+    }
+
+    void virtio_mmio::set_config(const void* data, size_t size) {
+        const vcml::u8* ptr = (const vcml::u8*)data;
+        m_config.assign(ptr, ptr + size);
+    }
+
+    void virtio_mmio::write_config(vcml::u64 offset, const void* data,
+                                   unsigned int size) {
+        /* read-only by default */
+    }
+
+    void virtio_mmio::device_reset() {
+        /* nothing to do */
+    }
+
+    virtio_mmio::virtio_mmio(const sc_core::sc_module_name& nm,
+                             vcml::u32 devid, unsigned int queues,
+                             vcml::u32 queue_max):
+        vcml::peripheral(nm),
+        m_device_id(devid),
+        m_queue_max(queue_max),
+        m_features(1ull << OR1KMVP_VIRTIO_F_VERSION_1 |
+                   1ull << OR1KMVP_VIRTIO_F_INDIRECT_DESC),
+        m_driver_features(0),
+        m_features_sel(0),
+        m_driver_features_sel(0),
+        m_queue_sel(0),
+        m_irq_status(0),
+        m_status(0),
+        m_config_gen(0),
+        m_queues(queues),
+        m_config(),
+        m_num_notifies(0),
+        m_num_requests(0),
+        IN("IN"),
+        OUT("OUT"),
+        IRQ("IRQ") {
+        /* nothing to do */
+    }
+
+    virtio_mmio::~virtio_mmio() {
+        /* nothing to do */
+    }
+
+    void virtio_mmio::reset_transport() {
+        m_driver_features = 0;
+        m_features_sel = 0;
+        m_driver_features_sel = 0;
+        m_queue_sel = 0;
+        m_irq_status = 0;
+        m_status = 0;
+
+        for (virtqueue& vq : m_queues)
+            memset(&vq, 0, sizeof(vq));
+    }
+
+    void virtio_mmio::reset() {
+        vcml::peripheral::reset();
+        reset_transport();
+        update_irq();
+        device_reset();
+    }
+
+    void virtio_mmio::save_state(checkpoint& cp) {
+        cp.write(m_driver_features);
+        cp.write(m_features_sel);
+        cp.write(m_driver_features_sel);
+        cp.write(m_queue_sel);
+        cp.write(m_irq_status);
+        cp.write(m_status);
+        cp.write(m_config_gen);
+
+        for (const virtqueue& vq : m_queues) {
+            cp.write(vq.size);
+            cp.write(vq.ready);
+            cp.write(vq.desc);
+            cp.write(vq.driver);
+            cp.write(vq.device);
+            cp.write(vq.last_avail);
+            cp.write(vq.used);
+        }
+    }
+
+    void virtio_mmio::load_state(checkpoint& cp) {
+        m_driver_features = cp.read<vcml::u64>();
+        m_features_sel = cp.read<vcml::u32>();
+        m_driver_features_sel = cp.read<vcml::u32>();
+        m_queue_sel = cp.read<vcml::u32>();
+        m_irq_status = cp.read<vcml::u32>();
+        m_status = cp.read<vcml::u32>();
+        m_config_gen = cp.read<vcml::u32>();
+
+        for (virtqueue& vq : m_queues) {
+            vq.size = cp.read<vcml::u32>();
+            vq.ready = cp.read<bool>();
+            vq.desc = cp.read<vcml::u64>();
+            vq.driver = cp.read<vcml::u64>();
+            vq.device = cp.read<vcml::u64>();
+            vq.last_avail = cp.read<vcml::u16>();
+            vq.used = cp.read<vcml::u16>();
+        }
+
+        update_irq();
+    }
+
+    tlm::tlm_response_status virtio_mmio::read(const vcml::range& addr,
+                                               void* data,
+                                               const vcml::sideband& info) {
+        vcml::u8* ptr = (vcml::u8*)data;
+        if (addr.start >= OR1KMVP_VIRTIO_CONFIG) {
+            vcml::u64 off = addr.start - OR1KMVP_VIRTIO_CONFIG;
+            for (vcml::u64 i = 0; i < addr.length(); i++)
+                ptr[i] = off + i < m_config.size() ? m_config[off + i] : 0;
+            return tlm::TLM_OK_RESPONSE;
+        }
+
+        if (addr.length() != 4 || (addr.start & 3))
+            return tlm::TLM_BURST_ERROR_RESPONSE;
+
+        virtio_put_le(ptr, read_reg(addr.start), 4);
+        return tlm::TLM_OK_RESPONSE;
+    }
+
+    tlm::tlm_response_status virtio_mmio::write(const vcml::range& addr,
+                                                const void* data,
+                                                const vcml::sideband& info) {
+        const vcml::u8* ptr = (const vcml::u8*)data;
+        if (addr.start >= OR1KMVP_VIRTIO_CONFIG) {
+            write_config(addr.start - OR1KMVP_VIRTIO_CONFIG, data,
+                         addr.length());
+            return tlm::TLM_OK_RESPONSE;
+        }
+
+        if (addr.length() != 4 || (addr.start & 3))
+            return tlm::TLM_BURST_ERROR_RESPONSE;
+
+        write_reg(addr.start, virtio_le32(ptr));
+        return tlm::TLM_OK_RESPONSE;
+    }
+
+}
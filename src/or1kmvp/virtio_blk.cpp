@@ -0,0 +1,229 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "or1kmvp/virtio_blk.h"
+
+#define OR1KMVP_VIRTIO_BLK_ID       (2)
+#define OR1KMVP_VIRTIO_BLK_QSIZE    (256)
+#define OR1KMVP_VIRTIO_BLK_SECTOR   (512)
+#define OR1KMVP_VIRTIO_BLK_SEGMAX   (128)
+
+#define OR1KMVP_VIRTIO_BLK_F_SEG_MAX  (2)
+#define OR1KMVP_VIRTIO_BLK_F_RO       (5)
+#define OR1KMVP_VIRTIO_BLK_F_BLK_SIZE (6)
+#define OR1KMVP_VIRTIO_BLK_F_FLUSH    (9)
+
+#define OR1KMVP_VIRTIO_BLK_T_IN     (0)
+#define OR1KMVP_VIRTIO_BLK_T_OUT    (1)
+#define OR1KMVP_VIRTIO_BLK_T_FLUSH  (4)
+#define OR1KMVP_VIRTIO_BLK_T_GET_ID (8)
+
+#define OR1KMVP_VIRTIO_BLK_S_OK     (0)
+#define OR1KMVP_VIRTIO_BLK_S_IOERR  (1)
+#define OR1KMVP_VIRTIO_BLK_S_UNSUPP (2)
+
+namespace or1kmvp {
+
+    void virtio_blk::open_image() {
+        if (image.get().empty())
+            return;
+
+        m_fd = ::open(image.get().c_str(), readonly ? O_RDONLY : O_RDWR);
+        if (m_fd < 0) {
+            log_warn("cannot open disk image %s: %s", image.get().c_str(),
+                     strerror(errno));
+            return;
+        }
+
+        off_t size = ::lseek(m_fd, 0, SEEK_END);
+        m_capacity = size < 0 ? 0 : size / OR1KMVP_VIRTIO_BLK_SECTOR;
+    }
+
+    void virtio_blk::update_config() {
+        vcml::u8 config[24] = { 0 };
+        virtio_put_le(config + 0, m_capacity, 8);
+        virtio_put_le(config + 12, OR1KMVP_VIRTIO_BLK_SEGMAX, 4);
+        virtio_put_le(config + 20, OR1KMVP_VIRTIO_BLK_SECTOR, 4);
+        set_config(config, sizeof(config));
+
+        vcml::u64 features = 1ull << OR1KMVP_VIRTIO_F_VERSION_1 |
+                             1ull << OR1KMVP_VIRTIO_F_INDIRECT_DESC |
+                             1ull << OR1KMVP_VIRTIO_BLK_F_SEG_MAX |
+                             1ull << OR1KMVP_VIRTIO_BLK_F_BLK_SIZE |
+                             1ull << OR1KMVP_VIRTIO_BLK_F_FLUSH;
+        if (readonly)
+            features |= 1ull << OR1KMVP_VIRTIO_BLK_F_RO;
+        set_features(features);
+    }
+
+    vcml::u8 virtio_blk::handle_request(const request& req) {
+        vcml::u8 hdr[16];
+        if (copy_out(req, 0, hdr, sizeof(hdr)) != sizeof(hdr) ||
+            req.in_size() == 0)
+            return OR1KMVP_VIRTIO_BLK_S_IOERR;
+
+        // sectors beyond the capacity would overflow when turned into a
+        // byte position, so they are rejected before that
+        vcml::u32 type = virtio_le32(hdr + 0);
+        vcml::u64 sector = virtio_le64(hdr + 8);
+        vcml::u64 end = m_capacity * OR1KMVP_VIRTIO_BLK_SECTOR;
+        vcml::u64 pos = std::min(sector, m_capacity) *
+                        OR1KMVP_VIRTIO_BLK_SECTOR;
+        size_t size;
+
+        switch (type) {
+        case OR1KMVP_VIRTIO_BLK_T_IN:
+            size = req.in_size() - 1; // last byte holds the status
+            if (m_fd < 0 || sector > m_capacity || size > end - pos)
+                return OR1KMVP_VIRTIO_BLK_S_IOERR;
+            if (!transfer(req.in, 0, size, pos, false))
+                return OR1KMVP_VIRTIO_BLK_S_IOERR;
+            m_num_reads++;
+            m_bytes_read += size;
+            return OR1KMVP_VIRTIO_BLK_S_OK;
+
+        case OR1KMVP_VIRTIO_BLK_T_OUT:
+            size = req.out_size() - sizeof(hdr);
+            if (m_fd < 0 || readonly || sector > m_capacity ||
+                size > end - pos)
+                return OR1KMVP_VIRTIO_BLK_S_IOERR;
+            if (!transfer(req.out, sizeof(hdr), size, pos, true))
+                return OR1KMVP_VIRTIO_BLK_S_IOERR;
+            m_num_writes++;
+            m_bytes_written += size;
+            return OR1KMVP_VIRTIO_BLK_S_OK;
+
+        case OR1KMVP_VIRTIO_BLK_T_FLUSH:
+            m_num_flushes++;
+            if (m_fd >= 0 && !readonly && ::fdatasync(m_fd) < 0)
+                return OR1KMVP_VIRTIO_BLK_S_IOERR;
+            return OR1KMVP_VIRTIO_BLK_S_OK;
+
+        case OR1KMVP_VIRTIO_BLK_T_GET_ID: {
+            char id[20] = { 0 };
+            strncpy(id, basename(), sizeof(id));
+            copy_in(req, 0, id, std::min(sizeof(id), req.in_size() - 1));
+            return OR1KMVP_VIRTIO_BLK_S_OK;
+        }
+
+        default:
+            return OR1KMVP_VIRTIO_BLK_S_UNSUPP;
+        }
+    }
+
+    bool virtio_blk::transfer(const std::vector<buffer>& bufs, size_t skip,
+                              size_t size, vcml::u64 pos, bool write) {
+        for (const buffer& buf : bufs) {
+            if (size == 0)
+                break;
+
+            if (skip >= buf.size) {
+                skip -= buf.size;
+                continue;
+            }
+
+            vcml::u32 n = std::min(buf.size - skip, size);
+            if (!transfer(buf.addr + skip, n, pos, write))
+                return false;
+
+            skip = 0;
+            size -= n;
+            pos += n;
+        }
+
+        return size == 0;
+    }
+
+    bool virtio_blk::transfer(vcml::u64 addr, vcml::u32 size, vcml::u64 pos,
+                              bool write) {
+        // Guest memory reached via DMI is used as the I/O buffer directly,
+        // everything else is bounced through a local buffer.
+        vcml::u8* ptr = dma_ptr(addr, size, !write);
+        std::vector<vcml::u8> bounce;
+        if (ptr == NULL) {
+            bounce.resize(size);
+            ptr = bounce.data();
+            if (write && !dma_read(addr, ptr, size))
+                return false;
+        }
+
+        for (vcml::u32 done = 0; done < size; ) {
+            ssize_t n = write ? ::pwrite(m_fd, ptr + done, size - done,
+                                         pos + done)
+                              : ::pread(m_fd, ptr + done, size - done,
+                                        pos + done);
+            if (n <= 0)
+                return false;
+            done += n;
+        }
+
+        if (!write && !bounce.empty())
+            return dma_write(addr, ptr, size);
+
+        return true;
+    }
+
+    void virtio_blk::handle_queue(unsigned int queue) {
+        bool used = false;
+        request req;
+        while (get_request(queue, req)) {
+            vcml::u8 status = handle_request(req);
+            if (req.in_size() > 0)
+                copy_in(req, req.in_size() - 1, &status, sizeof(status));
+
+            req.length = req.in_size();
+            put_request(queue, req);
+            used = true;
+        }
+
+        if (used)
+            notify_used(queue);
+    }
+
+    virtio_blk::virtio_blk(const sc_core::sc_module_name& nm):
+        virtio_mmio(nm, OR1KMVP_VIRTIO_BLK_ID, 1, OR1KMVP_VIRTIO_BLK_QSIZE),
+        m_fd(-1),
+        m_capacity(0),
+        m_num_reads(0),
+        m_num_writes(0),
+        m_num_flushes(0),
+        m_bytes_read(0),
+        m_bytes_written(0),
+        image("image", ""),
+        readonly("readonly", false) {
+        open_image();
+        update_config();
+    }
+
+    virtio_blk::~virtio_blk() {
+        if (m_fd >= 0)
+            ::close(m_fd);
+    }
+
+    void virtio_blk::end_of_simulation() {
+        virtio_mmio::end_of_simulation();
+        if (m_num_reads + m_num_writes == 0)
+            return;
+
+        log_info("%" PRId64 " reads (%.1fMB), %" PRId64 " writes (%.1fMB), "
+                 "%" PRId64 " flushes, %" PRId64 " notifies", m_num_reads,
+                 m_bytes_read / 1048576.0, m_num_writes,
+                 m_bytes_written / 1048576.0, m_num_flushes, num_notifies());
+    }
+
+}
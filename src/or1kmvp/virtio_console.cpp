@@ -0,0 +1,120 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "or1kmvp/virtio_console.h"
+
+#define OR1KMVP_VIRTIO_CONSOLE_ID    (3)
+#define OR1KMVP_VIRTIO_CONSOLE_QSIZE (128)
+#define OR1KMVP_VIRTIO_CONSOLE_RXQ   (0)
+#define OR1KMVP_VIRTIO_CONSOLE_TXQ   (1)
+
+namespace or1kmvp {
+
+    void virtio_console::transmit() {
+        bool used = false;
+        request req;
+
+        m_tx_buf.clear();
+        while (get_request(OR1KMVP_VIRTIO_CONSOLE_TXQ, req)) {
+            size_t off = m_tx_buf.size();
+            m_tx_buf.resize(off + req.out_size());
+            m_tx_buf.resize(off + copy_out(req, 0, m_tx_buf.data() + off,
+                                           req.out_size()));
+
+            req.length = 0;
+            put_request(OR1KMVP_VIRTIO_CONSOLE_TXQ, req);
+            used = true;
+        }
+
+        if (!m_tx_buf.empty()) {
+            bewrite(m_tx_buf.data(), m_tx_buf.size());
+            m_bytes_tx += m_tx_buf.size();
+        }
+
+        if (used) {
+            m_num_tx_batches++;
+            notify_used(OR1KMVP_VIRTIO_CONSOLE_TXQ);
+        }
+    }
+
+    void virtio_console::poll() {
+        bool used = false;
+        request req;
+
+        while (is_driver_ok() && bepeek()) {
+            if (!get_request(OR1KMVP_VIRTIO_CONSOLE_RXQ, req))
+                break;
+
+            m_rx_buf.resize(req.in_size());
+            size_t n = m_rx_buf.empty() ? 0 : beread(m_rx_buf.data(),
+                                                     m_rx_buf.size());
+            req.length = copy_in(req, 0, m_rx_buf.data(), n);
+            put_request(OR1KMVP_VIRTIO_CONSOLE_RXQ, req);
+            m_bytes_rx += req.length;
+            used = true;
+        }
+
+        if (used)
+            notify_used(OR1KMVP_VIRTIO_CONSOLE_RXQ);
+    }
+
+    void virtio_console::rx_thread() {
+        while (true) {
+            wait(rx_poll);
+            poll();
+        }
+    }
+
+    void virtio_console::handle_queue(unsigned int queue) {
+        if (queue == OR1KMVP_VIRTIO_CONSOLE_TXQ)
+            transmit();
+        else
+            poll();
+    }
+
+    virtio_console::virtio_console(const sc_core::sc_module_name& nm):
+        virtio_mmio(nm, OR1KMVP_VIRTIO_CONSOLE_ID, 2,
+                    OR1KMVP_VIRTIO_CONSOLE_QSIZE),
+        m_tx_buf(),
+        m_rx_buf(),
+        m_num_tx_batches(0),
+        m_bytes_tx(0),
+        m_bytes_rx(0),
+        rx_poll("rx_poll", sc_core::sc_time(1.0, sc_core::SC_MS)) {
+        vcml::u8 config[12] = { 0 }; // cols, rows, max_nr_ports, emerg_wr
+        set_config(config, sizeof(config));
+
+        SC_HAS_PROCESS(virtio_console);
+        SC_THREAD(rx_thread);
+    }
+
+    virtio_console::~virtio_console() {
+        /* nothing to do */
+    }
+
+    void virtio_console::end_of_simulation() {
+        virtio_mmio::end_of_simulation();
+        if (m_bytes_tx + m_bytes_rx == 0)
+            return;
+
+        log_info("%" PRId64 " bytes sent in %" PRId64 " batches, %" PRId64
+                 " bytes received", m_bytes_tx, m_num_tx_batches,
+                 m_bytes_rx);
+    }
+
+}
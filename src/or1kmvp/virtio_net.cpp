@@ -0,0 +1,215 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "or1kmvp/virtio_net.h"
+
+#define OR1KMVP_VIRTIO_NET_ID       (1)
+#define OR1KMVP_VIRTIO_NET_QSIZE    (256)
+#define OR1KMVP_VIRTIO_NET_RXQ      (0)
+#define OR1KMVP_VIRTIO_NET_TXQ      (1)
+#define OR1KMVP_VIRTIO_NET_HDR      (12) // incl. num_buffers for version 1
+#define OR1KMVP_VIRTIO_NET_FRAME    (65536)
+
+#define OR1KMVP_VIRTIO_NET_F_MAC       (5)
+#define OR1KMVP_VIRTIO_NET_F_MRG_RXBUF (15)
+#define OR1KMVP_VIRTIO_NET_F_STATUS    (16)
+
+#define OR1KMVP_VIRTIO_NET_S_LINK_UP (1)
+
+namespace or1kmvp {
+
+    void virtio_net::update_config() {
+        unsigned int m[6];
+        if (sscanf(mac.get().c_str(), "%x:%x:%x:%x:%x:%x", m + 0, m + 1,
+                   m + 2, m + 3, m + 4, m + 5) != 6) {
+            log_warn("invalid mac address '%s'", mac.get().c_str());
+            memset(m, 0, sizeof(m));
+        }
+
+        for (unsigned int i = 0; i < 6; i++)
+            m_mac[i] = (vcml::u8)m[i];
+
+        vcml::u8 config[8] = { 0 };
+        memcpy(config, m_mac, sizeof(m_mac));
+        virtio_put_le(config + 6, OR1KMVP_VIRTIO_NET_S_LINK_UP, 2);
+        set_config(config, sizeof(config));
+
+        set_features(1ull << OR1KMVP_VIRTIO_F_VERSION_1 |
+                     1ull << OR1KMVP_VIRTIO_F_INDIRECT_DESC |
+                     1ull << OR1KMVP_VIRTIO_NET_F_MAC |
+                     1ull << OR1KMVP_VIRTIO_NET_F_MRG_RXBUF |
+                     1ull << OR1KMVP_VIRTIO_NET_F_STATUS);
+    }
+
+    void virtio_net::transmit() {
+        bool used = false;
+        request req;
+        while (get_request(OR1KMVP_VIRTIO_NET_TXQ, req)) {
+            size_t size = req.out_size();
+            if (size > OR1KMVP_VIRTIO_NET_HDR) {
+                size = std::min(size - OR1KMVP_VIRTIO_NET_HDR,
+                                m_tx_frame.size());
+                size = copy_out(req, OR1KMVP_VIRTIO_NET_HDR,
+                                m_tx_frame.data(), size);
+                bewrite(m_tx_frame.data(), size);
+                m_num_tx_frames++;
+                m_bytes_tx += size;
+            }
+
+            req.length = 0;
+            put_request(OR1KMVP_VIRTIO_NET_TXQ, req);
+            used = true;
+        }
+
+        if (used) {
+            m_num_tx_batches++;
+            notify_used(OR1KMVP_VIRTIO_NET_TXQ);
+        }
+    }
+
+    bool virtio_net::receive() {
+        // Without mergeable buffers the frame must fit into one request,
+        // otherwise take as many as needed and publish them all together.
+        bool merge = has_feature(OR1KMVP_VIRTIO_NET_F_MRG_RXBUF);
+        size_t size = OR1KMVP_VIRTIO_NET_HDR + m_rx_size;
+        size_t space = 0;
+
+        m_rx_reqs.clear();
+        while (space < size && (merge || m_rx_reqs.empty())) {
+            request req;
+            if (!get_request(OR1KMVP_VIRTIO_NET_RXQ, req)) {
+                for (size_t i = 0; i < m_rx_reqs.size(); i++)
+                    unget_request(OR1KMVP_VIRTIO_NET_RXQ);
+                return false;
+            }
+
+            space += req.in_size();
+            m_rx_reqs.push_back(req);
+        }
+
+        if (space < size) {
+            log_debug("dropping %zu byte frame, buffer too small", m_rx_size);
+            put_requests(OR1KMVP_VIRTIO_NET_RXQ, m_rx_reqs); // length 0
+            m_num_rx_dropped++;
+            return true;
+        }
+
+        vcml::u8 hdr[OR1KMVP_VIRTIO_NET_HDR] = { 0 };
+        virtio_put_le(hdr + 10, m_rx_reqs.size(), 2);
+
+        size_t off = 0;
+        for (request& req : m_rx_reqs) {
+            size_t skip = 0;
+            if (&req == &m_rx_reqs.front())
+                skip = copy_in(req, 0, hdr, sizeof(hdr));
+
+            size_t n = std::min(req.in_size() - skip, m_rx_size - off);
+            copy_in(req, skip, m_rx_frame.data() + off, n);
+            req.length = skip + n;
+            off += n;
+        }
+
+        put_requests(OR1KMVP_VIRTIO_NET_RXQ, m_rx_reqs);
+        m_num_rx_frames++;
+        m_bytes_rx += m_rx_size;
+        return true;
+    }
+
+    void virtio_net::poll() {
+        // A frame that did not fit into the receive queue is kept until the
+        // driver provides more buffers, so the backends are not drained
+        // while the guest cannot keep up.
+        bool used = false;
+        while (is_driver_ok()) {
+            if (m_rx_size == 0) {
+                if (!bepeek())
+                    break;
+                m_rx_size = beread(m_rx_frame.data(), m_rx_frame.size());
+                if (m_rx_size == 0)
+                    break;
+            }
+
+            if (!receive())
+                break;
+
+            m_rx_size = 0;
+            used = true;
+        }
+
+        if (used) {
+            m_num_rx_batches++;
+            notify_used(OR1KMVP_VIRTIO_NET_RXQ);
+        }
+    }
+
+    void virtio_net::rx_thread() {
+        while (true) {
+            wait(rx_poll);
+            poll();
+        }
+    }
+
+    void virtio_net::handle_queue(unsigned int queue) {
+        if (queue == OR1KMVP_VIRTIO_NET_TXQ)
+            transmit();
+        else
+            poll(); // new receive buffers, deliver pending frames now
+    }
+
+    void virtio_net::device_reset() {
+        m_rx_size = 0;
+    }
+
+    virtio_net::virtio_net(const sc_core::sc_module_name& nm):
+        virtio_mmio(nm, OR1KMVP_VIRTIO_NET_ID, 2, OR1KMVP_VIRTIO_NET_QSIZE),
+        m_tx_frame(OR1KMVP_VIRTIO_NET_FRAME),
+        m_rx_frame(OR1KMVP_VIRTIO_NET_FRAME),
+        m_rx_size(0),
+        m_rx_reqs(),
+        m_num_tx_frames(0),
+        m_num_tx_batches(0),
+        m_num_rx_frames(0),
+        m_num_rx_batches(0),
+        m_num_rx_dropped(0),
+        m_bytes_tx(0),
+        m_bytes_rx(0),
+        mac("mac", "3a:44:1d:55:11:5b"),
+        rx_poll("rx_poll", sc_core::sc_time(100.0, sc_core::SC_US)) {
+        update_config();
+
+        SC_HAS_PROCESS(virtio_net);
+        SC_THREAD(rx_thread);
+    }
+
+    virtio_net::~virtio_net() {
+        /* nothing to do */
+    }
+
+    void virtio_net::end_of_simulation() {
+        virtio_mmio::end_of_simulation();
+        if (m_num_tx_frames + m_num_rx_frames == 0)
+            return;
+
+        log_info("%" PRId64 " frames sent (%.1fMB) in %" PRId64 " batches, "
+                 "%" PRId64 " frames received (%.1fMB) in %" PRId64
+                 " batches, %" PRId64 " dropped", m_num_tx_frames,
+                 m_bytes_tx / 1048576.0, m_num_tx_batches, m_num_rx_frames,
+                 m_bytes_rx / 1048576.0, m_num_rx_batches, m_num_rx_dropped);
+    }
+
+}
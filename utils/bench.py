@@ -0,0 +1,227 @@
+#!/usr/bin/env python3
+
+
+ ##############################################################################
+ #                                                                            #
+ # Copyright 2018 Jan Henrik Weinstock                                        #
+ #                                                                            #
+ # Licensed under the Apache License, Version 2.0 (the "License");            #
+ # you may not use this file except in compliance with the License.           #
+ # You may obtain a copy of the License at                                    #
+ #                                                                            #
+ #     http://www.apache.org/licenses/LICENSE-2.0                             #
+ #                                                                            #
+ # Unless required by applicable law or agreed to in writing, software        #
+ # distributed under the License is distributed on an "AS IS" BASIS,          #
+ # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   #
+ # See the License for the specific language governing permissions and        #
+ # limitations under the License.                                             #
+ #                                                                            #
+ ##############################################################################
+
+"""Runs a matrix of simulator configurations and guest workloads and records
+boot time, workload time and the statistics printed by or1kmvp at the end of
+each run. Results are written as JSON and CSV and optionally compared against
+the JSON results of an earlier run."""
+
+import argparse
+import csv
+import itertools
+import json
+import os
+import re
+import signal
+import subprocess
+import sys
+import time
+
+CONFIGS = { "up": 1, "smp2": 2, "smp4": 4 }
+
+# bytes sent by the network workloads, used to compute their throughput
+NET_BYTES = { "ethtx": 16 << 20, "vnettx": 16 << 20 }
+
+STATS = {
+    "duration":  r"duration\s+([\d.]+)s",
+    "runtime":   r"runtime\s+([\d.]+)s",
+    "rtratio":   r"real time ratio\s+([\d.]+)s",
+    "mips":      r"sim speed\s+([\d.]+) MIPS",
+}
+
+CPU_STATS = {
+    "iss_mips":     r"iss speed\s+([\d.]+) MIPS",
+    "instructions": r"instructions\s+(\d+)",
+    "sleep":        r"sleep-cycles\s+\d+ \(([\d.]+)%\)",
+    "jit_hitrate":  r"jit hit-rate\s+([\d.]+)",
+}
+
+KEY = [ "config", "dmi", "decode", "quantum", "workload" ]
+METRICS = [ "boot", "workload_time", "runtime", "rtratio", "mips", "mbps" ]
+
+def onoff(s):
+    return [ v.strip() == "on" for v in s.split(",") ]
+
+def run(args, config, dmi, decode, quantum, workload):
+    ncpu = CONFIGS[config]
+    cmd = [ "expect", "-f", args.expect, workload, args.sim,
+            "-f", os.path.join(args.config_dir, config + ".cfg"),
+            "-c", "system.quantum=" + quantum,
+            "-c", "system.sdcard0.readonly=true",
+            "-c", "system.sdcard1.readonly=true",
+            "-c", "system.ocfbc.display=",
+            "-c", "system.ockbd.display=" ]
+    if workload == "vdaread":
+        image = os.path.join(args.config_dir, "..", "sw", "sdcard0.gpt")
+        cmd += [ "-c", "system.vblk.image=" + image,
+                 "-c", "system.vblk.readonly=true" ]
+    if workload in NET_BYTES:
+        # frames go nowhere, so no host network setup is needed
+        cmd += [ "-c", "system.ethoc.backends=null",
+                 "-c", "system.vnet.backends=null" ]
+    if workload in ("ttylog", "hvclog"):
+        cmd += [ "-c", "system.uart1.backends=null",
+                 "-c", "system.vcon.backends=null" ]
+    for cpu in range(ncpu):
+        prefix = "system.cpu%d." % cpu
+        cmd += [ "-c", prefix + "enable_insn_dmi=%d" % dmi,
+                 "-c", prefix + "enable_data_dmi=%d" % dmi,
+                 "-c", prefix + "enable_decode_cache=%d" % decode ]
+
+    # expect and the simulator it spawns get their own session, so that
+    # both can be killed if the run hangs
+    start = time.time()
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE,
+                            stderr=subprocess.STDOUT,
+                            universal_newlines=True, start_new_session=True)
+    try:
+        output, _ = proc.communicate(timeout=args.timeout)
+        status = proc.returncode
+    except subprocess.TimeoutExpired:
+        os.killpg(proc.pid, signal.SIGKILL)
+        output, _ = proc.communicate()
+        status = "timeout"
+        print("timed out after %ds" % args.timeout, flush=True)
+
+    result = { "config": config, "dmi": dmi, "decode": decode,
+               "quantum": quantum, "workload": workload,
+               "wallclock": time.time() - start,
+               "status": status }
+
+    for line in output.splitlines():
+        m = re.match(r"BENCH (\w+) (\d+)", line)
+        if m:
+            key = "boot" if m.group(1) == "boot" else "workload_time"
+            result[key] = int(m.group(2)) / 1000.0
+            continue
+
+        for name, regex in STATS.items():
+            m = re.search(regex, line)
+            if m and name not in result:
+                result[name] = float(m.group(1))
+
+        cpu = re.search(r"cpu(\d+)", line)
+        for name, regex in CPU_STATS.items():
+            m = re.search(regex, line)
+            if m and cpu:
+                result["cpu%s_%s" % (cpu.group(1), name)] = float(m.group(1))
+
+    if workload in NET_BYTES and result.get("workload_time"):
+        result["mbps"] = NET_BYTES[workload] * 8 / 1e6 / \
+                         result["workload_time"]
+
+    return result
+
+def key(result):
+    return tuple(str(result.get(k)) for k in KEY)
+
+def compare(results, baseline, threshold):
+    # higher is better for mips and mbps, lower is better for all times
+    base = { key(r): r for r in baseline }
+    regressions = 0
+    for r in results:
+        b = base.get(key(r))
+        if b is None:
+            continue
+
+        for metric in METRICS:
+            if metric not in r or not b.get(metric):
+                continue
+
+            change = (r[metric] - b[metric]) / b[metric]
+            worse = -change if metric in ("mips", "mbps") else change
+            mark = ""
+            if worse > threshold:
+                mark = "  REGRESSION"
+                regressions += 1
+            print("%-40s %-14s %10.3f -> %10.3f (%+6.1f%%)%s" %
+                  ("/".join(key(r)), metric, b[metric], r[metric],
+                   change * 100.0, mark))
+
+    return regressions
+
+def main():
+    here = os.path.dirname(os.path.realpath(__file__))
+    expect = os.path.join(here, "or1kmvp-bench.exp") # installed location
+    if not os.path.exists(expect):
+        expect = os.path.join(here, "..", "test", "bench.exp")
+
+    parser = argparse.ArgumentParser(description="or1kmvp benchmark suite")
+    parser.add_argument("--sim", default="or1kmvp")
+    parser.add_argument("--config-dir", default=os.path.join(here, "..",
+                                                             "config"))
+    parser.add_argument("--expect", default=expect)
+    parser.add_argument("--configs", default="up,smp2,smp4")
+    parser.add_argument("--dmi", default="on,off")
+    parser.add_argument("--decode-cache", default="on,off")
+    parser.add_argument("--quantum", default="1us,4us,16us")
+    parser.add_argument("--workloads", default="boot,memcpy,syscall,ipi")
+    parser.add_argument("--repeat", type=int, default=1)
+    parser.add_argument("--timeout", type=int, default=1800)
+    parser.add_argument("--output", default="bench")
+    parser.add_argument("--baseline", default="")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="regression threshold in percent")
+    args = parser.parse_args()
+
+    matrix = itertools.product(args.configs.split(","), onoff(args.dmi),
+                               onoff(args.decode_cache),
+                               args.quantum.split(","),
+                               args.workloads.split(","))
+
+    results = []
+    for config, dmi, decode, quantum, workload in matrix:
+        if workload == "ipi" and CONFIGS[config] == 1:
+            continue # needs at least two cores
+
+        for i in range(args.repeat):
+            print("running %s dmi=%d decode=%d quantum=%s %s (%d/%d)" %
+                  (config, dmi, decode, quantum, workload, i + 1,
+                   args.repeat), flush=True)
+            r = run(args, config, dmi, decode, quantum, workload)
+            r["repeat"] = i
+            results.append(r)
+
+    with open(args.output + ".json", "w") as f:
+        json.dump(results, f, indent=2)
+
+    columns = []
+    for r in results:
+        columns += [ c for c in r.keys() if c not in columns ]
+    with open(args.output + ".csv", "w") as f:
+        writer = csv.DictWriter(f, fieldnames=columns)
+        writer.writeheader()
+        writer.writerows(results)
+
+    failed = [ r for r in results if r["status"] != 0 ]
+    for r in failed:
+        print("failed: %s (%s)" % ("/".join(key(r)), r["status"]))
+
+    regressions = 0
+    if args.baseline:
+        with open(args.baseline) as f:
+            regressions = compare(results, json.load(f),
+                                  args.threshold / 100.0)
+
+    return 1 if failed or regressions else 0
+
+if __name__ == "__main__":
+    sys.exit(main())
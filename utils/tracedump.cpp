@@ -0,0 +1,201 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright 2018 Jan Henrik Weinstock                                        *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License");            *
+ * you may not use this file except in compliance with the License.           *
+ * You may obtain a copy of the License at                                    *
+ *                                                                            *
+ *     http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ *                                                                            *
+ ******************************************************************************/
+
+#include <cstdio>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <getopt.h>
+
+#include "or1kmvp/traceformat.h"
+
+using namespace or1kmvp;
+
+static bool read_u32(FILE* f, uint32_t& val) {
+    uint8_t buf[4];
+    if (fread(buf, 1, sizeof(buf), f) != sizeof(buf))
+        return false;
+    val = buf[0] | buf[1] << 8 | buf[2] << 16 | (uint32_t)buf[3] << 24;
+    return true;
+}
+
+static bool read_plain(FILE* f, trace_entry& entry) {
+    uint8_t buf[22];
+    if (fread(buf, 1, sizeof(buf), f) != sizeof(buf))
+        return false;
+
+    entry.core = buf[0];
+    entry.reg = buf[1];
+    entry.cycle = 0;
+    for (int i = 0; i < 8; i++)
+        entry.cycle |= (uint64_t)buf[2 + i] << (i * 8);
+    entry.pc = entry.count = entry.value = 0;
+    for (int i = 0; i < 4; i++) {
+        entry.pc |= (uint32_t)buf[10 + i] << (i * 8);
+        entry.count |= (uint32_t)buf[14 + i] << (i * 8);
+        entry.value |= (uint32_t)buf[18 + i] << (i * 8);
+    }
+
+    return true;
+}
+
+static bool read_delta(FILE* f, trace_entry& entry, uint64_t* cycles,
+                       uint32_t* pcs) {
+    int tag = fgetc(f);
+    if (tag == EOF)
+        return false;
+
+    unsigned int core = tag & (OR1KMVP_TRACE_MAXCORE - 1);
+    entry.core = core;
+    entry.cycle = cycles[core];
+    entry.pc = pcs[core];
+    entry.count = 0;
+    entry.value = 0;
+
+    if (tag & OR1KMVP_TRACE_TAG_REG) {
+        int reg = fgetc(f);
+        uint64_t value = 0;
+        if (reg == EOF || !trace_get_varint(f, value))
+            return false;
+        entry.reg = reg;
+        entry.value = value;
+        return true;
+    }
+
+    uint64_t delta = 0;
+    if (!trace_get_varint(f, delta))
+        return false;
+
+    entry.reg = OR1KMVP_TRACE_NOREG;
+    entry.cycle = cycles[core] + delta;
+    if (!(tag & OR1KMVP_TRACE_TAG_SEQ)) {
+        if (!trace_get_varint(f, delta))
+            return false;
+        entry.pc = pcs[core] + trace_unzigzag(delta);
+    }
+
+    uint64_t count = 0;
+    if (!trace_get_varint(f, count))
+        return false;
+    entry.count = count;
+
+    cycles[core] = entry.cycle;
+    pcs[core] = entry.pc + 4 * entry.count;
+    return true;
+}
+
+static void usage(const char* name) {
+    printf("Usage: %s [-c core] [-n count] [-i] <tracefile>\n", name);
+    printf("  -c core   only show blocks from the given core\n");
+    printf("  -n count  stop after count instructions\n");
+    printf("  -i        list every instruction address of a block\n");
+}
+
+int main(int argc, char** argv) {
+    int only_core = -1;
+    uint64_t limit = ~0ull;
+    bool expand = false;
+
+    int c;
+    while ((c = getopt(argc, argv, "c:n:ih")) != -1) {
+        switch (c) {
+        case 'c': only_core = atoi(optarg); break;
+        case 'n': limit = strtoull(optarg, NULL, 0); break;
+        case 'i': expand = true; break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (optind >= argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE* f = fopen(argv[optind], "rb");
+    if (f == NULL) {
+        perror(argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    char magic[8];
+    uint32_t version = 0, flags = 0;
+    if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) ||
+        strncmp(magic, OR1KMVP_TRACE_MAGIC, sizeof(magic)) != 0 ||
+        !read_u32(f, version) || !read_u32(f, flags)) {
+        fprintf(stderr, "%s: not an or1kmvp trace file\n", argv[optind]);
+        fclose(f);
+        return EXIT_FAILURE;
+    }
+
+    if (version != OR1KMVP_TRACE_VERSION) {
+        fprintf(stderr, "%s: unsupported trace version %u\n", argv[optind],
+                version);
+        fclose(f);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t cycles[OR1KMVP_TRACE_MAXCORE] = { 0 };
+    uint32_t pcs[OR1KMVP_TRACE_MAXCORE] = { 0 };
+    uint64_t count = 0;
+
+    trace_entry entry;
+    while (count < limit) {
+        bool ok = (flags & OR1KMVP_TRACE_DELTA) ?
+            read_delta(f, entry, cycles, pcs) : read_plain(f, entry);
+        if (!ok)
+            break;
+
+        if (only_core >= 0 && entry.core != only_core)
+            continue;
+
+        switch (entry.reg) {
+        case OR1KMVP_TRACE_NOREG:
+            printf("%u %12" PRIu64 " %08x: %u instructions\n", entry.core,
+                   entry.cycle, entry.pc, entry.count);
+            if (expand) {
+                for (uint32_t i = 0; i < entry.count; i++)
+                    printf("%u %12s %08x\n", entry.core, "",
+                           entry.pc + 4 * i);
+            }
+            count += entry.count;
+            break;
+
+        case OR1KMVP_TRACE_EXCEPTION:
+            printf("%u %12s exception, epcr = 0x%08x\n", entry.core, "",
+                   entry.value);
+            break;
+
+        case OR1KMVP_TRACE_UNTRACED:
+            printf("%u %12s %u handler instructions not traced\n",
+                   entry.core, "", entry.value);
+            count += entry.value;
+            break;
+
+        default:
+            printf("%u %12s r%u = 0x%08x\n", entry.core, "", entry.reg,
+                   entry.value);
+            break;
+        }
+    }
+
+    fclose(f);
+    return EXIT_SUCCESS;
+}